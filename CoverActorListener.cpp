@@ -0,0 +1,11 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoverActorListener.h"
+#include "CoverGen.h"
+
+void UCoverActorListener::OnActorDestroyed(AActor* DestroyedActor)
+{
+	if (coverGen)
+		coverGen->OnActorDestroyed(DestroyedActor);
+}
@@ -0,0 +1,24 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "CoverActorListener.generated.h"
+
+class CoverGen;
+
+/**
+ * Forwards actor events that are only exposed as dynamic delegates to CoverGen (which isn't a UObject)
+ */
+UCLASS()
+class COVERSYSTEM_API UCoverActorListener : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	CoverGen* coverGen = nullptr;
+
+	UFUNCTION()
+	void OnActorDestroyed(AActor* DestroyedActor);
+};
@@ -0,0 +1,495 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+//Synthetic levels pushed through the whole CoverCore pipeline, for catching generation regressions without the engine
+//CoverBenchmark [--csv <path>] [--runs <count>] [--scale <factor>] [--bisect] [--check] [--check-allocations]
+//--check compares every scene with the results recorded in SceneExpectations and exits with 1 if anything changed
+//only CMakeLists.txt defines COVERCORE_STANDALONE, so the module build doesn't get a second main
+#if defined(COVERCORE_STANDALONE)
+
+#include "CoverCore.h"
+#include "CoverMockWorld.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+//Every heap allocation of the process is counted, blocks carry their size in front of them so live bytes can be tracked too
+static const size_t AllocationHeaderSize = alignof(std::max_align_t);
+static std::atomic<uint64_t> AllocationCount(0);
+static std::atomic<uint64_t> AllocatedBytes(0);
+static std::atomic<int64_t>  LiveBytes(0);
+static std::atomic<int64_t>  PeakLiveBytes(0);
+
+static void* CountedAlloc(size_t size)
+{
+	unsigned char* block = (unsigned char*)std::malloc(size + AllocationHeaderSize);
+	if (!block)
+		return nullptr;
+
+	*(size_t*)block = size;
+	AllocationCount.fetch_add(1, std::memory_order_relaxed);
+	AllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+	const int64_t liveBytes = LiveBytes.fetch_add((int64_t)size, std::memory_order_relaxed) + (int64_t)size;
+	int64_t peakBytes = PeakLiveBytes.load(std::memory_order_relaxed);
+	while (liveBytes > peakBytes && !PeakLiveBytes.compare_exchange_weak(peakBytes, liveBytes, std::memory_order_relaxed))
+		continue;
+
+	return block + AllocationHeaderSize;
+}
+
+static void CountedFree(void* pointer)
+{
+	if (!pointer)
+		return;
+
+	unsigned char* block = (unsigned char*)pointer - AllocationHeaderSize;
+	LiveBytes.fetch_sub((int64_t)*(size_t*)block, std::memory_order_relaxed);
+	std::free(block);
+}
+
+void* operator new(size_t size)
+{
+	if (void* pointer = CountedAlloc(size))
+		return pointer;
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)                                  { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept    { return CountedAlloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept  { return CountedAlloc(size); }
+void  operator delete(void* pointer) noexcept                      { CountedFree(pointer); }
+void  operator delete[](void* pointer) noexcept                    { CountedFree(pointer); }
+void  operator delete(void* pointer, size_t) noexcept              { CountedFree(pointer); }
+void  operator delete[](void* pointer, size_t) noexcept            { CountedFree(pointer); }
+void  operator delete(void* pointer, const std::nothrow_t&) noexcept   { CountedFree(pointer); }
+void  operator delete[](void* pointer, const std::nothrow_t&) noexcept { CountedFree(pointer); }
+
+static void ReadAllocationCounters(CoverCore::AllocationCounters& outCounters)
+{
+	outCounters.allocations = AllocationCount.load(std::memory_order_relaxed);
+	outCounters.bytes = AllocatedBytes.load(std::memory_order_relaxed);
+}
+
+using namespace CoverCore;
+
+namespace
+{
+	//same numbers on every platform, unlike the distributions of <random>
+	struct BenchmarkRandom
+	{
+		uint32_t state;
+
+		explicit BenchmarkRandom(uint32_t seed) : state(seed) {}
+
+		float Range(float min, float max)
+		{
+			state = state * 1664525u + 1013904223u;
+			return min + (max - min) * (float)(state >> 8) / 16777216.0f;
+		}
+	};
+
+	//objects of a synthetic level, bFromGeometry is the CoverFromGeometry tag of every object
+	struct BenchmarkScene
+	{
+		std::string name;
+		MockWorld world;
+		std::vector<bool> bFromGeometry;
+
+		void AddBox(const Vector& vCenter, const Vector& vHalfSize, float yawDegrees)
+		{
+			world.AddBox(vCenter, vHalfSize, yawDegrees);
+			bFromGeometry.push_back(false);
+		}
+
+		void AddMesh(const std::vector<Vector>& triangles)
+		{
+			world.AddMesh(triangles);
+			bFromGeometry.push_back(true);
+		}
+	};
+
+	struct SceneResult
+	{
+		GenerationStats stats;
+		int32_t objects    = 0; //objects that gave cover
+		int32_t nodes      = 0;
+		int32_t slots      = 0; //cover spots along the segments
+		double  wallSeconds = 0.0;
+		int64_t peakHeapBytes = 0; //above what was allocated before the scene started generating
+		size_t  arenaBytes = 0;    //edge-link arena blocks still reserved at the end
+		float   maxPackedPositionError = 0.0f; //largest distance between a node and its packed node (heights included)
+		float   minPackedNormalDot = 1.0f;     //normals of packed nodes closest to facing away from the generated ones
+		int32_t packedNodesOffStep = 0;        //nodes decoded more than half a step (per axis) away from where they were generated
+	};
+
+	//results of every scene at scale 1, bisected sweeps have to give the same cover
+	//update them only together with a change that is meant to change the generated cover, packed errors are upper bounds
+	struct SceneExpectation
+	{
+		const char* name;
+		int32_t objects;
+		int32_t nodes;
+		int32_t nodesCreated;
+		int32_t nodesMerged;
+		int32_t nodesRemoved;
+		int32_t segments;
+		int32_t slots;
+		float   maxPackedPositionError;
+		float   maxPackedNormalErrorDegrees;
+	};
+
+	const SceneExpectation SceneExpectations[] =
+	{
+		{ "Boxes",          400, 2000, 18390, 1600, 14790, 1600, 4798, 0.001f, 0.01f },
+		{ "RotatedBoxes",   400, 3408, 22261, 9800,  9053, 2015, 5021, 0.012f, 0.65f },
+		{ "HighPolyMeshes",  16,  749,  1536,  336,   451,  176,  256, 0.011f, 0.44f },
+		{ "Clutter",        624, 4639, 14043, 4121,  5283, 2895, 4689, 0.014f, 0.46f },
+	};
+
+	inline float GetPackedNormalErrorDegrees(const SceneResult& result) { return std::acos(std::min(1.0f, result.minPackedNormalDot)) * 57.2957795f; }
+
+	bool CheckValue(const BenchmarkScene& scene, const char* valueName, int32_t value, int32_t expected)
+	{
+		if (value == expected)
+			return true;
+
+		std::fprintf(stderr, "%s: %d %s, expected %d\n", scene.name.c_str(), value, valueName, expected);
+		return false;
+	}
+
+	bool CheckBound(const BenchmarkScene& scene, const char* valueName, float value, float bound)
+	{
+		if (value <= bound)
+			return true;
+
+		std::fprintf(stderr, "%s: %s %.4f, expected at most %.4f\n", scene.name.c_str(), valueName, value, bound);
+		return false;
+	}
+
+	bool CheckResult(const BenchmarkScene& scene, const SceneResult& result)
+	{
+		for (const SceneExpectation& expectation : SceneExpectations)
+		{
+			if (scene.name != expectation.name)
+				continue;
+
+			const GenerationStats& stats = result.stats;
+			bool bPassed = CheckValue(scene, "objects with cover", result.objects, expectation.objects);
+			bPassed &= CheckValue(scene, "nodes", result.nodes, expectation.nodes);
+			bPassed &= CheckValue(scene, "nodes created", stats.nodesCreated, expectation.nodesCreated);
+			bPassed &= CheckValue(scene, "nodes merged", stats.nodesMerged, expectation.nodesMerged);
+			bPassed &= CheckValue(scene, "nodes removed", stats.nodesRemoved, expectation.nodesRemoved);
+			bPassed &= CheckValue(scene, "segments", stats.segments, expectation.segments);
+			bPassed &= CheckValue(scene, "slots", result.slots, expectation.slots);
+			bPassed &= CheckValue(scene, "packed nodes off their step", result.packedNodesOffStep, 0);
+			bPassed &= CheckBound(scene, "packed position error", result.maxPackedPositionError, expectation.maxPackedPositionError);
+			bPassed &= CheckBound(scene, "packed normal error (degrees)", GetPackedNormalErrorDegrees(result), expectation.maxPackedNormalErrorDegrees);
+			return bPassed;
+		}
+
+		std::fprintf(stderr, "%s: no expectation recorded\n", scene.name.c_str());
+		return false;
+	}
+
+	//every node is packed around its object's bounds center and decoded again, the way CoverGen stores finished objects
+	void MeasurePackedNodes(const NodeArrays& nodes, const ObjectInput& input, SceneResult& result)
+	{
+		const PackedNodeFrame frame = MakePackedNodeFrame(nodes, input.vBoundsCenter);
+
+		for (NodeHandle node = 0; node < nodes.Num(); ++node)
+		{
+			const PackedNode packed = PackNode(frame, nodes.positions[node], nodes.normals[node], nodes.heights[node], nodes.flags[node]);
+			const float positionError = Vector::Dist(UnpackPosition(frame, packed), nodes.positions[node]);
+			const float heightError = std::abs(UnpackHeight(frame, packed) - nodes.heights[node]);
+
+			result.maxPackedPositionError = std::max(result.maxPackedPositionError, std::max(positionError, heightError));
+
+			//rounding to the nearest step, a little more for float error
+			if (positionError > frame.step * 0.87f || heightError > frame.step * 0.51f)
+				result.packedNodesOffStep++;
+			result.minPackedNormalDot = std::min(result.minPackedNormalDot, Vector::Dot(UnpackNormal(packed), nodes.normals[node]));
+		}
+	}
+
+	//boxes on a grid, rotated ones can't use analytic cover so every column is traced
+	void BuildBoxGrid(BenchmarkScene& scene, int32_t count, bool bRotated)
+	{
+		const int32_t side = (int32_t)std::ceil(std::sqrt((float)count));
+
+		for (int32_t box = 0; box < count; ++box)
+		{
+			const Vector vHalfSize(100.0f + 50.0f * (box % 3), 50.0f + 25.0f * (box % 2), 150.0f);
+			const Vector vCenter(600.0f * (box % side), 600.0f * (box / side), vHalfSize.Z);
+			scene.AddBox(vCenter, vHalfSize, bRotated ? 15.0f + (float)((box * 37) % 60) : 0.0f);
+		}
+	}
+
+	//closed cylinder with a wavy wall, wound so its faces point out
+	std::vector<Vector> MakePillar(const Vector& vBase, float radius, float height, int32_t segments, int32_t rings)
+	{
+		std::vector<Vector> triangles;
+		triangles.reserve((size_t)segments * (rings * 2 + 2) * 3);
+
+		auto wallPoint = [&](int32_t segment, int32_t ring)
+		{
+			const float angle = 6.28318531f * (float)(segment % segments) / (float)segments;
+			const float wallRadius = radius * (1.0f + 0.05f * std::sin(angle * 5.0f));
+			return vBase + Vector(std::cos(angle) * wallRadius, std::sin(angle) * wallRadius, height * (float)ring / (float)rings);
+		};
+
+		const Vector vTop = vBase + Vector(0.0f, 0.0f, height);
+
+		for (int32_t segment = 0; segment < segments; ++segment)
+		{
+			for (int32_t ring = 0; ring < rings; ++ring)
+			{
+				const Vector A = wallPoint(segment, ring), B = wallPoint(segment + 1, ring);
+				const Vector C = wallPoint(segment + 1, ring + 1), D = wallPoint(segment, ring + 1);
+				triangles.insert(triangles.end(), { A, B, C, A, C, D });
+			}
+
+			triangles.insert(triangles.end(), { vTop, wallPoint(segment, rings), wallPoint(segment + 1, rings) });
+			triangles.insert(triangles.end(), { vBase, wallPoint(segment + 1, 0), wallPoint(segment, 0) });
+		}
+
+		return triangles;
+	}
+
+	void BuildHighPolyMeshes(BenchmarkScene& scene, int32_t count)
+	{
+		const int32_t side = (int32_t)std::ceil(std::sqrt((float)count));
+
+		for (int32_t mesh = 0; mesh < count; ++mesh)
+			scene.AddMesh(MakePillar(Vector(800.0f * (mesh % side), 800.0f * (mesh / side), 0.0f), 150.0f, 300.0f, 96, 24));
+	}
+
+	//crates packed close together, some too low to give cover, most of them touching their neighbours' rays
+	void BuildClutter(BenchmarkScene& scene, int32_t count)
+	{
+		BenchmarkRandom random(12345u);
+		const float areaSize = 250.0f * std::sqrt((float)count);
+
+		for (int32_t crate = 0; crate < count; ++crate)
+		{
+			const Vector vHalfSize(random.Range(30.0f, 90.0f), random.Range(30.0f, 90.0f), random.Range(60.0f, 200.0f));
+			const Vector vCenter(random.Range(0.0f, areaSize), random.Range(0.0f, areaSize), vHalfSize.Z);
+			const float yaw = random.Range(0.0f, 90.0f);
+			scene.AddBox(vCenter, vHalfSize, crate % 4 == 0 ? 0.0f : yaw);
+		}
+	}
+
+	//workspace and nodes are kept from run to run the way the engine keeps them from object to object
+	SceneResult RunScene(const BenchmarkScene& scene, const GenerationSettings& settings, Workspace& workspace, NodeArrays& nodes, std::vector<CoverSegment>& segments)
+	{
+		SceneResult result;
+
+		const int64_t startLiveBytes = LiveBytes.load();
+		PeakLiveBytes.store(startLiveBytes);
+		const auto startTime = std::chrono::steady_clock::now();
+
+		for (int32_t object = 0; object < scene.world.Num(); ++object)
+		{
+			//bounds and triangles stand in for the geometry the engine adapter reads from the actor
+			AllocationCounters geometryStart, geometryEnd;
+			ReadAllocationCounters(geometryStart);
+			const auto geometryStartTime = std::chrono::steady_clock::now();
+
+			const ObjectInput input = scene.world.MakeObjectInput(object, scene.bFromGeometry[object]);
+
+			result.stats.phaseSeconds[GP_Geometry] += std::chrono::duration<double>(std::chrono::steady_clock::now() - geometryStartTime).count();
+			ReadAllocationCounters(geometryEnd);
+			result.stats.phaseAllocations[GP_Geometry] += geometryEnd.allocations - geometryStart.allocations;
+			result.stats.phaseAllocatedBytes[GP_Geometry] += geometryEnd.bytes - geometryStart.bytes;
+
+			MockRayQuery rays(scene.world, object, &result.stats);
+
+			if (GenerateObjectCover(input, settings, rays, workspace, nodes, segments, &result.stats))
+			{
+				result.objects++;
+				result.nodes += nodes.Num();
+				result.slots += segments.empty() ? 0 : segments.back().firstSlot + segments.back().slotCount;
+				MeasurePackedNodes(nodes, input, result);
+			}
+		}
+
+		result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		result.peakHeapBytes = PeakLiveBytes.load() - startLiveBytes;
+		result.arenaBytes = workspace.edgeArena.GetBytesReserved();
+		return result;
+	}
+
+	void PrintResult(const BenchmarkScene& scene, int32_t run, const SceneResult& result)
+	{
+		const GenerationStats& stats = result.stats;
+		std::printf("%s (run %d): %d objects, %d with cover, %d nodes, %d rays (%d hits, %d misses), %.2f ms, peak heap %lld bytes\n",
+			scene.name.c_str(), run, scene.world.Num(), result.objects, result.nodes, stats.raysCast, stats.rayHits, stats.rayMisses, result.wallSeconds * 1000.0, (long long)result.peakHeapBytes);
+		std::printf("  nodes: %d created, %d merged, %d removed, %d segments with %d slots\n", stats.nodesCreated, stats.nodesMerged, stats.nodesRemoved, stats.segments, result.slots);
+		std::printf("  packed: %llu bytes (%d per node), max position error %.4f, max normal error %.3f degrees\n", (unsigned long long)result.nodes * sizeof(PackedNode), (int)sizeof(PackedNode),
+			result.maxPackedPositionError, GetPackedNormalErrorDegrees(result));
+
+		for (int32_t phase = 0; phase < GP_Count; ++phase)
+			std::printf("  %-15s %10.3f ms %10llu allocations %12llu bytes\n", GenerationPhaseNames[phase], stats.phaseSeconds[phase] * 1000.0,
+				(unsigned long long)stats.phaseAllocations[phase], (unsigned long long)stats.phaseAllocatedBytes[phase]);
+	}
+
+	//one row per scene and run, phase columns follow GenerationPhaseNames
+	void WriteCsvHeader(FILE* csv)
+	{
+		std::fprintf(csv, "Scene,Run,Objects,ObjectsWithCover,Nodes,RaysCast,RayHits,RayMisses,NodesCreated,NodesMerged,NodesRemoved,Segments,Slots,WallMs,PeakHeapBytes,ArenaBytes,PackedBytes,MaxPackedPositionError,MinPackedNormalDot");
+
+		for (const char* phaseName : GenerationPhaseNames)
+			std::fprintf(csv, ",%sMs,%sAllocations,%sBytes", phaseName, phaseName, phaseName);
+
+		std::fprintf(csv, "\n");
+	}
+
+	void WriteCsvRow(FILE* csv, const BenchmarkScene& scene, int32_t run, const SceneResult& result)
+	{
+		const GenerationStats& stats = result.stats;
+		std::fprintf(csv, "%s,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%.3f,%lld,%llu,%llu,%.5f,%.6f", scene.name.c_str(), run, scene.world.Num(), result.objects, result.nodes,
+			stats.raysCast, stats.rayHits, stats.rayMisses, stats.nodesCreated, stats.nodesMerged, stats.nodesRemoved, stats.segments, result.slots, result.wallSeconds * 1000.0, (long long)result.peakHeapBytes, (unsigned long long)result.arenaBytes,
+			(unsigned long long)result.nodes * sizeof(PackedNode), result.maxPackedPositionError, result.minPackedNormalDot);
+
+		for (int32_t phase = 0; phase < GP_Count; ++phase)
+			std::fprintf(csv, ",%.3f,%llu,%llu", stats.phaseSeconds[phase] * 1000.0, (unsigned long long)stats.phaseAllocations[phase], (unsigned long long)stats.phaseAllocatedBytes[phase]);
+
+		std::fprintf(csv, "\n");
+	}
+
+	//allocations of the phases CoverCore runs, geometry is read by the host and doesn't count
+	uint64_t GetCoreAllocations(const GenerationStats& stats)
+	{
+		uint64_t allocations = 0;
+		for (int32_t phase = GP_EdgeLinks; phase <= GP_Optimization; ++phase)
+			allocations += stats.phaseAllocations[phase];
+
+		return allocations;
+	}
+
+	int PrintUsage()
+	{
+		std::fprintf(stderr, "usage: CoverBenchmark [--csv <path>] [--runs <count>] [--scale <factor>] [--bisect] [--check] [--check-allocations]\n");
+		return 1;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* csvPath = nullptr;
+	int32_t runs = 1;
+	float scale = 1.0f;
+	bool bCheck = false;
+	bool bCheckAllocations = false; //fail if a run after the first allocates, its buffers are all warm by then
+	GenerationSettings settings;
+
+	for (int argIndex = 1; argIndex < argc; ++argIndex)
+	{
+		const bool bHasValue = argIndex + 1 < argc;
+
+		if (std::strcmp(argv[argIndex], "--csv") == 0 && bHasValue)
+			csvPath = argv[++argIndex];
+
+		else if (std::strcmp(argv[argIndex], "--runs") == 0 && bHasValue)
+			runs = std::max(1, std::atoi(argv[++argIndex]));
+
+		else if (std::strcmp(argv[argIndex], "--scale") == 0 && bHasValue)
+			scale = std::max(0.01f, (float)std::atof(argv[++argIndex]));
+
+		else if (std::strcmp(argv[argIndex], "--bisect") == 0)
+			settings.bBisectHeights = true;
+
+		else if (std::strcmp(argv[argIndex], "--check") == 0)
+			bCheck = true;
+
+		else if (std::strcmp(argv[argIndex], "--check-allocations") == 0)
+			bCheckAllocations = true;
+
+		else
+			return PrintUsage();
+	}
+
+	//expectations are recorded for the default levels only
+	if (bCheck && scale != 1.0f)
+	{
+		std::fprintf(stderr, "--check can't be combined with --scale\n");
+		return 1;
+	}
+
+	if (bCheckAllocations)
+		runs = std::max(2, runs);
+
+	auto scaled = [scale](int32_t count) { return std::max(1, (int32_t)(count * scale)); };
+
+	std::vector<BenchmarkScene> scenes(4);
+	scenes[0].name = "Boxes";          BuildBoxGrid(scenes[0], scaled(400), false);
+	scenes[1].name = "RotatedBoxes";   BuildBoxGrid(scenes[1], scaled(400), true);
+	scenes[2].name = "HighPolyMeshes"; BuildHighPolyMeshes(scenes[2], scaled(16));
+	scenes[3].name = "Clutter";        BuildClutter(scenes[3], scaled(1000));
+
+	FILE* csv = nullptr;
+	if (csvPath)
+	{
+		csv = std::fopen(csvPath, "w");
+		if (!csv)
+		{
+			std::fprintf(stderr, "Couldn't write benchmark results to %s\n", csvPath);
+			return 1;
+		}
+
+		WriteCsvHeader(csv);
+	}
+
+	SetAllocationCounter(&ReadAllocationCounters);
+	bool bPassed = true;
+
+	Workspace workspace;
+	NodeArrays nodes;
+	std::vector<CoverSegment> segments;
+	bool bSteadyStateAllocated = false;
+
+	for (const BenchmarkScene& scene : scenes)
+		for (int32_t run = 0; run < runs; ++run)
+		{
+			const SceneResult result = RunScene(scene, settings, workspace, nodes, segments);
+			PrintResult(scene, run, result);
+
+			if (csv)
+				WriteCsvRow(csv, scene, run, result);
+
+			if (bCheck)
+				bPassed &= CheckResult(scene, result);
+
+			const uint64_t coreAllocations = GetCoreAllocations(result.stats);
+			if (bCheckAllocations && run > 0 && coreAllocations > 0)
+			{
+				std::fprintf(stderr, "%s (run %d): generation allocated %llu times after the first run\n", scene.name.c_str(), run, (unsigned long long)coreAllocations);
+				bSteadyStateAllocated = true;
+			}
+		}
+
+	SetAllocationCounter(nullptr);
+
+	if (csv)
+		std::fclose(csv);
+
+	if (!bPassed)
+	{
+		std::fprintf(stderr, "Generated cover doesn't match the recorded expectations\n");
+		return 1;
+	}
+
+	if (bSteadyStateAllocated)
+		return 1;
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,1339 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoverCore.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+
+namespace CoverCore
+{
+	const char* const GenerationPhaseNames[GP_Count] = { "Geometry", "EdgeLinks", "RaySweeps", "Merge", "UpDownRemoval", "Optimization", "OccupancyBoxes" };
+
+	//Sweeps
+	static const float MinObjectTop   = 226.0f;   //objects that don't reach this high don't give cover
+	static const float MaxBoxTop      = 50000.0f; //bounding boxes above it aren't cover (sky spheres, level bounds)
+	static const float MinCover       = 50.0f;
+	static const float MaxCover       = 180.0f;
+	static const float GroundLevel    = 130.0f;
+	static const float LargeOffset    = 100.0f;   //how far away from the bounding box/geometry we shoot the rays from (lowering it can help with narrow spaces)
+	static const int32_t MissAcceptance = 2;
+
+	//Packed nodes: finest fixed point step, 1/64 of a unit is well below what a node's position means for an agent
+	static const float PackedNodeMinStep = 1.0f / 64.0f;
+
+	static AllocationCounterFn AllocationCounter = nullptr;
+
+	namespace
+	{
+		//integer cell of a grid, hashed for CellTable
+		struct CellKey
+		{
+			int32_t X, Y, Z;
+
+			bool operator==(const CellKey& other) const { return X == other.X && Y == other.Y && Z == other.Z; }
+			bool operator<(const CellKey& other) const  { return X != other.X ? X < other.X : (Y != other.Y ? Y < other.Y : Z < other.Z); }
+		};
+
+		//open addressing map from cells to values, its arrays are kept from object to object so it doesn't allocate once they are big enough
+		class CellTable
+		{
+		public:
+			//empties the table, it has to be able to hold expectedCount cells without growing
+			void Reset(size_t expectedCount)
+			{
+				size_t capacity = 16;
+				while (capacity < expectedCount * 2)
+					capacity *= 2;
+
+				_keys.resize(capacity);
+				_values.resize(capacity);
+				_bUsed.assign(capacity, 0);
+				_mask = capacity - 1;
+			}
+
+			//-1 if the cell isn't in the table
+			int32_t Find(const CellKey& cell) const
+			{
+				for (size_t slot = Hash(cell) & _mask; _bUsed[slot]; slot = (slot + 1) & _mask)
+					if (_keys[slot] == cell)
+						return _values[slot];
+
+				return -1;
+			}
+
+			//cells that aren't in the table yet are added with defaultValue
+			int32_t& FindOrAdd(const CellKey& cell, int32_t defaultValue)
+			{
+				size_t slot = Hash(cell) & _mask;
+				for (; _bUsed[slot]; slot = (slot + 1) & _mask)
+					if (_keys[slot] == cell)
+						return _values[slot];
+
+				_bUsed[slot] = 1;
+				_keys[slot] = cell;
+				_values[slot] = defaultValue;
+				return _values[slot];
+			}
+
+		private:
+			static size_t Hash(const CellKey& cell)
+			{
+				const uint32_t hash = ((uint32_t)cell.X * 73856093u) ^ ((uint32_t)cell.Y * 19349663u) ^ ((uint32_t)cell.Z * 83492791u);
+				return hash ^ (hash >> 16);
+			}
+
+			std::vector<CellKey> _keys;
+			std::vector<int32_t> _values;
+			std::vector<uint8_t> _bUsed;
+			size_t _mask = 0;
+		};
+
+		inline int32_t FloorToInt(float value) { return (int32_t)std::floor(value); }
+
+		//adds the time (and allocations) until the end of the scope to a phase, nothing is timed without stats
+		struct ScopedPhaseTimer
+		{
+			GenerationStats* stats;
+			IPhaseObserver*  observer;
+			GenerationPhase  phase;
+			AllocationCounters startAllocations;
+			std::chrono::steady_clock::time_point startTime;
+
+			ScopedPhaseTimer(GenerationStats* generationStats, GenerationPhase generationPhase, IPhaseObserver* phaseObserver = nullptr) : stats(generationStats), observer(phaseObserver), phase(generationPhase)
+			{
+				if (observer)
+					observer->OnPhaseStarted(phase);
+
+				if (!stats)
+					return;
+
+				if (AllocationCounter)
+					AllocationCounter(startAllocations);
+
+				startTime = std::chrono::steady_clock::now();
+			}
+
+			~ScopedPhaseTimer()
+			{
+				if (stats)
+				{
+					stats->phaseSeconds[phase] += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+					if (AllocationCounter)
+					{
+						AllocationCounters endAllocations;
+						AllocationCounter(endAllocations);
+						stats->phaseAllocations[phase] += endAllocations.allocations - startAllocations.allocations;
+						stats->phaseAllocatedBytes[phase] += endAllocations.bytes - startAllocations.bytes;
+					}
+				}
+
+				if (observer)
+					observer->OnPhaseFinished(phase);
+			}
+		};
+
+		//uniform grid over the nodes of a single object, nodes are sorted by cell so every cell is a range of 'nodes'
+		struct NodeGrid
+		{
+			float fCellSize = 1.0f;
+			bool  b2D       = false; //cells are XY columns split by whole units of Z instead of fCellSize
+			std::vector<NodeHandle> nodes;
+			std::vector<CellKey> nodeCells;
+			std::vector<std::pair<int32_t, int32_t>> cellRanges; //first node, node count
+			CellTable cells;                                      //index of the cell's range
+
+			CellKey GetCell(const Vector& position) const
+			{
+				return { FloorToInt(position.X / fCellSize), FloorToInt(position.Y / fCellSize), b2D ? FloorToInt(position.Z) : FloorToInt(position.Z / fCellSize) };
+			}
+
+			void Build(const NodeArrays& nodeArrays, float cellSize, bool bColumns)
+			{
+				//very small cells would overflow the cell coordinates
+				fCellSize = std::max(cellSize, 1.0f);
+				b2D = bColumns;
+				nodes.resize(nodeArrays.Num());
+				nodeCells.resize(nodeArrays.Num());
+
+				for (NodeHandle node = 0; node < nodeArrays.Num(); ++node)
+				{
+					nodeCells[node] = GetCell(nodeArrays.positions[node]);
+					nodes[node] = node;
+				}
+
+				//group nodes of the same cell together, the order inside a cell doesn't matter
+				const std::vector<CellKey>& cellOfNode = nodeCells;
+				std::sort(nodes.begin(), nodes.end(), [&cellOfNode](NodeHandle A, NodeHandle B) { return cellOfNode[A] < cellOfNode[B]; });
+
+				cells.Reset(nodes.size());
+				cellRanges.clear();
+
+				for (int32_t index = 0; index < (int32_t)nodes.size(); ++index)
+				{
+					int32_t& range = cells.FindOrAdd(nodeCells[nodes[index]], -1);
+					if (range == -1)
+					{
+						range = (int32_t)cellRanges.size();
+						cellRanges.push_back(std::make_pair(index, 0));
+					}
+
+					cellRanges[range].second++;
+				}
+			}
+
+			//every node that can be within radius, and some that aren't
+			void GetCandidates(const Vector& position, float radius, std::vector<NodeHandle>& outCandidates) const
+			{
+				outCandidates.clear();
+
+				//cells that overlap a slightly larger box, so a rounded distance can't put a node in a cell that isn't searched
+				const Vector extent(radius * 1.01f, radius * 1.01f, radius * 1.01f);
+				CellKey minCell = GetCell(position - extent);
+				CellKey maxCell = GetCell(position + extent);
+
+				if (b2D)
+					minCell.Z = maxCell.Z = FloorToInt(position.Z);
+
+				for (int32_t x = minCell.X; x <= maxCell.X; ++x)
+					for (int32_t y = minCell.Y; y <= maxCell.Y; ++y)
+						for (int32_t z = minCell.Z; z <= maxCell.Z; ++z)
+						{
+							const int32_t range = cells.Find({ x, y, z });
+							if (range != -1)
+								outCandidates.insert(outCandidates.end(), nodes.begin() + cellRanges[range].first, nodes.begin() + cellRanges[range].first + cellRanges[range].second);
+						}
+			}
+		};
+
+		inline bool NormalCheck2D(const Vector& normal, float range) { return normal.X < range && normal.X > -range && normal.Y < range && normal.Y > -range; }
+
+		inline void AddEdgeLink(Arena& arena, const Vector& V0, const Vector& V1, const Vector& triangleNormal, std::vector<EdgeLink*>& edgesOut, bool ignoreSurfacesWithVerticalFaces)
+		{
+			if ((triangleNormal.Z < 0.8f && triangleNormal.Z > -0.8f) || !ignoreSurfacesWithVerticalFaces)
+			{
+				Vector linkDirection = V1 - V0;
+				linkDirection.Normalize();
+
+				if ((linkDirection.Z < 0.8f && linkDirection.Z > -0.8f) || !ignoreSurfacesWithVerticalFaces)
+					edgesOut.push_back(arena.New<EdgeLink>(V0, V1, triangleNormal, linkDirection));
+			}
+		}
+
+		//link from a used vertex to another vertex of one of its triangles
+		struct EdgeCandidate
+		{
+			int32_t order;
+			int32_t triangle;
+			int32_t from;
+			int32_t to;
+		};
+
+		//a used vertex links to the lowest used vertex after it (in vertexOrder) of every triangle it belongs to
+		void CreateEdgeLinks(const std::vector<Vector>& triangles, const WeldedGeometry& geometry, const std::vector<int32_t>& vertexOrder, Arena& arena, std::vector<EdgeCandidate>& candidates, std::vector<EdgeLink*>& edgesOut)
+		{
+			candidates.clear();
+			const std::vector<int32_t>& indices = geometry.indices;
+
+			for (int32_t V = 2; V < (int32_t)indices.size(); V += 3)
+			{
+				//Single Triangle (same winding as the soup was read in)
+				const int32_t corners[3] = { indices[V - 0], indices[V - 1], indices[V - 2] };
+
+				//triangles that collapsed while welding don't have a valid normal
+				if (corners[0] == corners[1] || corners[0] == corners[2] || corners[1] == corners[2])
+					continue;
+
+				for (int32_t corner = 0; corner < 3; ++corner)
+				{
+					const int32_t from = corners[corner];
+					const int32_t fromOrder = vertexOrder[from];
+
+					if (fromOrder == -1)
+						continue;
+
+					int32_t to = -1;
+					for (int32_t other = 1; other <= 2; ++other)
+					{
+						const int32_t candidate = corners[(corner + other) % 3];
+						const int32_t candidateOrder = vertexOrder[candidate];
+
+						if (candidateOrder > fromOrder && (to == -1 || candidateOrder < vertexOrder[to]))
+							to = candidate;
+					}
+
+					if (to != -1)
+						candidates.push_back({ fromOrder, V / 3, from, to });
+				}
+			}
+
+			//links go out vertex by vertex, from the lowest one
+			std::sort(candidates.begin(), candidates.end(), [](const EdgeCandidate& A, const EdgeCandidate& B)
+			{
+				return A.order != B.order ? A.order < B.order : A.triangle < B.triangle;
+			});
+
+			edgesOut.reserve(edgesOut.size() + candidates.size());
+
+			for (const EdgeCandidate& candidate : candidates)
+			{
+				const int32_t V = candidate.triangle * 3 + 2;
+				const Vector& V0 = triangles[V - 0];
+				const Vector& V1 = triangles[V - 1];
+				const Vector& V2 = triangles[V - 2];
+				Vector vNormal = Vector::Cross(V1 - V0, V2 - V0);
+				vNormal.Normalize();
+
+				AddEdgeLink(arena, geometry.vertices[candidate.from], geometry.vertices[candidate.to], vNormal, edgesOut, true);
+			}
+		}
+	}
+
+	struct Workspace::Buffers
+	{
+		//BuildMeshColumns
+		WeldedGeometry geometry;
+		CellTable cellTable;              //welded vertices by cell, then used X & Y
+		std::vector<int32_t> nextInCell;
+		std::vector<int32_t> verts;
+		std::vector<int32_t> vertexOrder;
+		std::vector<EdgeCandidate> edgeCandidates;
+		std::vector<EdgeLink*> edgeLinks;
+
+		//merging and optimization
+		NodeGrid grid;
+		std::vector<NodeHandle> candidates;
+		std::vector<NodeHandle> nodeList; //nodes that are kept, chained or removed
+		std::vector<bool> bNodeMarks;     //duplicate or chained
+		NodeArrays reorderScratch;
+	};
+
+	Workspace::Workspace() : _buffers(new Buffers()) {}
+	Workspace::~Workspace() {}
+
+	NodeHandle NodeArrays::Add(const Vector& position, const Vector& normal)
+	{
+		positions.push_back(position);
+		normals.push_back(normal);
+		heights.push_back(position.Z);
+		flags.push_back(NF_None);
+		return Num() - 1;
+	}
+
+	void NodeArrays::Reorder(const std::vector<NodeHandle>& order, NodeArrays& scratch)
+	{
+		scratch.Clear();
+		scratch.Reserve((int32_t)order.size());
+
+		for (NodeHandle node : order)
+		{
+			scratch.positions.push_back(positions[node]);
+			scratch.normals.push_back(normals[node]);
+			scratch.heights.push_back(heights[node]);
+			scratch.flags.push_back(flags[node]);
+		}
+
+		//scratch keeps our old arrays for the next reorder
+		positions.swap(scratch.positions);
+		normals.swap(scratch.normals);
+		heights.swap(scratch.heights);
+		flags.swap(scratch.flags);
+	}
+
+	void NodeArrays::Remove(const std::vector<NodeHandle>& nodesToBeRemoved)
+	{
+		//compact in place, the order of the remaining nodes doesn't change
+		size_t nextRemoved = 0;
+		int32_t kept = 0;
+
+		for (NodeHandle node = 0; node < Num(); ++node)
+		{
+			if (nextRemoved < nodesToBeRemoved.size() && nodesToBeRemoved[nextRemoved] == node)
+			{
+				nextRemoved++;
+				continue;
+			}
+
+			positions[kept] = positions[node];
+			normals[kept]   = normals[node];
+			heights[kept]   = heights[node];
+			flags[kept]     = flags[node];
+			kept++;
+		}
+
+		positions.resize(kept);
+		normals.resize(kept);
+		heights.resize(kept);
+		flags.resize(kept);
+	}
+
+	PackedNodeFrame MakePackedNodeFrame(const NodeArrays& nodes, const Vector& vOrigin)
+	{
+		//positions get the whole int16 range, heights only 14 bits
+		float requiredStep = 0.0f;
+
+		for (NodeHandle node = 0; node < nodes.Num(); ++node)
+		{
+			const Vector vOffset = nodes.positions[node] - vOrigin;
+			const float maxOffset = std::max(std::abs(vOffset.X), std::max(std::abs(vOffset.Y), std::abs(vOffset.Z)));
+			requiredStep = std::max(requiredStep, std::max(maxOffset / 32767.0f, nodes.heights[node] / (float)PackedHeightMask));
+		}
+
+		PackedNodeFrame frame;
+		frame.vOrigin = vOrigin;
+		frame.step = PackedNodeMinStep;
+
+		while (frame.step < requiredStep)
+			frame.step *= 2.0f;
+
+		return frame;
+	}
+
+	PackedNode PackNode(const PackedNodeFrame& frame, const Vector& position, const Vector& normal, float height, uint8_t flags)
+	{
+		const Vector vSteps = (position - frame.vOrigin) / frame.step;
+		const int32_t heightSteps = (int32_t)std::lround(height / frame.step);
+
+		PackedNode packed;
+		for (int32_t axis = 0; axis < 3; ++axis)
+			packed.position[axis] = (int16_t)std::min(32767L, std::max(-32767L, std::lround(vSteps[axis])));
+
+		packed.normal = EncodeOctahedralNormal(normal);
+		packed.heightAndFlags = (uint16_t)(std::min((int32_t)PackedHeightMask, std::max(0, heightSteps)) | ((flags & 3) << PackedFlagsShift));
+		return packed;
+	}
+
+	uint16_t EncodeOctahedralNormal(const Vector& normal)
+	{
+		//project onto the octahedron, the lower half is folded over the diagonals
+		const float sum = std::abs(normal.X) + std::abs(normal.Y) + std::abs(normal.Z);
+		float U = sum > 0.0f ? normal.X / sum : 0.0f;
+		float V = sum > 0.0f ? normal.Y / sum : 0.0f;
+
+		if (normal.Z < 0.0f)
+		{
+			const float foldedU = (1.0f - std::abs(V)) * (U >= 0.0f ? 1.0f : -1.0f);
+			const float foldedV = (1.0f - std::abs(U)) * (V >= 0.0f ? 1.0f : -1.0f);
+			U = foldedU;
+			V = foldedV;
+		}
+
+		//-1..1 maps to 0..254, so 0 and +-1 are exact and axis aligned normals decode without error
+		const uint16_t encodedU = (uint16_t)std::lround((U * 0.5f + 0.5f) * 254.0f);
+		const uint16_t encodedV = (uint16_t)std::lround((V * 0.5f + 0.5f) * 254.0f);
+		return (uint16_t)(encodedU | (encodedV << 8));
+	}
+
+	Vector DecodeOctahedralNormal(uint16_t encoded)
+	{
+		const float U = (encoded & 0xFF) / 127.0f - 1.0f;
+		const float V = (encoded >> 8) / 127.0f - 1.0f;
+
+		Vector normal(U, V, 1.0f - std::abs(U) - std::abs(V));
+		if (normal.Z < 0.0f)
+		{
+			normal.X = (1.0f - std::abs(V)) * (U >= 0.0f ? 1.0f : -1.0f);
+			normal.Y = (1.0f - std::abs(U)) * (V >= 0.0f ? 1.0f : -1.0f);
+		}
+
+		normal.Normalize();
+		return normal;
+	}
+
+	void NodeArrays::Clear()
+	{
+		positions.clear();
+		normals.clear();
+		heights.clear();
+		flags.clear();
+	}
+
+	void NodeArrays::Reserve(int32_t count)
+	{
+		positions.reserve(count);
+		normals.reserve(count);
+		heights.reserve(count);
+		flags.reserve(count);
+	}
+
+	Arena::~Arena()
+	{
+		for (Block& block : _blocks)
+			std::free(block.data);
+	}
+
+	void* Arena::Allocate(size_t size, size_t alignment)
+	{
+		//only the last block has free space, the ones before it are full
+		if (!_blocks.empty())
+		{
+			Block& block = _blocks.back();
+			const size_t offset = (block.used + alignment - 1) & ~(alignment - 1);
+
+			if (offset + size <= block.size)
+			{
+				block.used = offset + size;
+				_bytesUsed += size;
+				return block.data + offset;
+			}
+		}
+
+		Block newBlock;
+		newBlock.size = std::max(_blockSize, size + alignment);
+		newBlock.data = (uint8_t*)std::malloc(newBlock.size);
+		newBlock.used = size;
+		_blocks.push_back(newBlock);
+
+		_bytesUsed += size;
+		return newBlock.data;
+	}
+
+	void Arena::Reset()
+	{
+		//several blocks are replaced with one that fits all of them, so the same object doesn't need more than one block next time
+		if (_blocks.size() > 1)
+		{
+			const size_t bytesReserved = GetBytesReserved();
+
+			for (Block& block : _blocks)
+				std::free(block.data);
+
+			_blocks.resize(1);
+			_blocks[0].data = (uint8_t*)std::malloc(bytesReserved);
+			_blocks[0].size = bytesReserved;
+		}
+
+		if (!_blocks.empty())
+			_blocks[0].used = 0;
+
+		_bytesUsed = 0;
+	}
+
+	size_t Arena::GetBytesReserved() const
+	{
+		size_t bytesReserved = 0;
+		for (const Block& block : _blocks)
+			bytesReserved += block.size;
+
+		return bytesReserved;
+	}
+
+	void GenerationStats::Add(const GenerationStats& other)
+	{
+		raysCast     += other.raysCast;
+		rayHits      += other.rayHits;
+		rayMisses    += other.rayMisses;
+		nodesCreated += other.nodesCreated;
+		nodesMerged  += other.nodesMerged;
+		nodesRemoved += other.nodesRemoved;
+		segments     += other.segments;
+
+		for (int32_t phase = 0; phase < GP_Count; ++phase)
+		{
+			phaseSeconds[phase]        += other.phaseSeconds[phase];
+			phaseAllocations[phase]    += other.phaseAllocations[phase];
+			phaseAllocatedBytes[phase] += other.phaseAllocatedBytes[phase];
+		}
+	}
+
+	double GenerationStats::GetTotalSeconds() const
+	{
+		double totalSeconds = 0.0;
+
+		for (double seconds : phaseSeconds)
+			totalSeconds += seconds;
+
+		return totalSeconds;
+	}
+
+	void SetAllocationCounter(AllocationCounterFn counter)
+	{
+		AllocationCounter = counter;
+	}
+
+	bool MakeSweepParams(const Vector& vBoundsCenter, const Vector& vBoundsHalfSize, float spacing, SweepParams& outSweep)
+	{
+		const float fTop = vBoundsCenter.Z + vBoundsHalfSize.Z;
+
+		if (fTop < MinObjectTop)
+			return false;
+
+		//to calculate how far up we can go
+		const float fBottom = vBoundsCenter.Z - vBoundsHalfSize.Z;
+		const bool bClipsThroughGround = fBottom < GroundLevel;
+
+		outSweep.fBottom        = bClipsThroughGround ? GroundLevel : fBottom;
+		outSweep.fTop           = fTop;
+		outSweep.minCover       = MinCover;
+		outSweep.maxCover       = MaxCover;
+		outSweep.spacing        = spacing;
+		outSweep.missAcceptance = MissAcceptance;
+		outSweep.maxDistance    = LargeOffset + spacing + 200.0f;
+		outSweep.faceOffset     = LargeOffset;
+		return true;
+	}
+
+	void BuildBoxColumns(const Vector& vBoundsCenter, const Vector& vBoundsHalfSize, const SweepParams& sweep, std::vector<RayColumn>& outColumns)
+	{
+		if (sweep.fTop >= MaxBoxTop)
+			return;
+
+		//TODO: fix the min bounding box
+		const float largeOffset = sweep.faceOffset;
+		const float spacing = sweep.spacing;
+		const Vector leftFront  = Vector(vBoundsCenter.X - vBoundsHalfSize.X, vBoundsCenter.Y - vBoundsHalfSize.Y, vBoundsCenter.Z);
+		const Vector rightFront = Vector(vBoundsCenter.X - vBoundsHalfSize.X, vBoundsCenter.Y + vBoundsHalfSize.Y, vBoundsCenter.Z);
+		const Vector leftBack   = Vector(vBoundsCenter.X + vBoundsHalfSize.X, vBoundsCenter.Y - vBoundsHalfSize.Y, vBoundsCenter.Z);
+		const Vector rightBack  = Vector(vBoundsCenter.X + vBoundsHalfSize.X, vBoundsCenter.Y + vBoundsHalfSize.Y, vBoundsCenter.Z);
+
+		//shoot multiple rays from 4 directions:
+		//############ on Y axis front ############//
+		for (float offset = 0.0f; leftFront.Y + offset <= rightFront.Y; offset += spacing)
+			outColumns.push_back(RayColumn(Vector(leftFront.X - largeOffset, leftFront.Y + offset, 0.0f), Vector(), Vector(1.0f, 0.0f, 0.0f), 1));
+
+		//############ on X axis right ############//
+		for (float offset = 0.0f; rightFront.X + offset <= rightBack.X; offset += spacing)
+			outColumns.push_back(RayColumn(Vector(rightFront.X + offset, rightFront.Y + largeOffset, 0.0f), Vector(), Vector(0.0f, -1.0f, 0.0f), 4));
+
+		//############ on Y axis back ############//
+		for (float offset = 0.0f; leftBack.Y <= rightBack.Y - offset; offset += spacing)
+			outColumns.push_back(RayColumn(Vector(rightBack.X + largeOffset, rightBack.Y - offset, 0.0f), Vector(), Vector(-1.0f, 0.0f, 0.0f), 3));
+
+		//############ on X axis left ############//
+		for (float offset = 0.0f; leftFront.X <= leftBack.X - offset; offset += spacing)
+			outColumns.push_back(RayColumn(Vector(leftBack.X - offset, leftBack.Y - largeOffset, 0.0f), Vector(), Vector(0.0f, 1.0f, 0.0f), 2));
+	}
+
+	void WeldTriangleVertices(const std::vector<Vector>& triangles, Workspace& workspace, WeldedGeometry& outGeometry)
+	{
+		outGeometry.vertices.clear();
+		outGeometry.indices.clear();
+		outGeometry.indices.reserve(triangles.size());
+
+		//vertices are hashed by their 1 unit cell, cells of a single vertex are chained through nextInCell
+		CellTable& firstInCell = workspace.GetBuffers().cellTable;
+		std::vector<int32_t>& nextInCell = workspace.GetBuffers().nextInCell;
+		firstInCell.Reset(triangles.size());
+		nextInCell.clear();
+
+		for (const Vector& vertex : triangles)
+		{
+			const CellKey cell = { FloorToInt(vertex.X), FloorToInt(vertex.Y), FloorToInt(vertex.Z) };
+			int32_t weldedIndex = -1;
+
+			//a vertex closer than 1 unit can only be in one of the neighbouring cells
+			for (int32_t x = -1; x <= 1 && weldedIndex == -1; ++x)
+				for (int32_t y = -1; y <= 1 && weldedIndex == -1; ++y)
+					for (int32_t z = -1; z <= 1 && weldedIndex == -1; ++z)
+					{
+						for (int32_t candidate = firstInCell.Find({ cell.X + x, cell.Y + y, cell.Z + z }); candidate != -1; candidate = nextInCell[candidate])
+							if (Vector::Dist(vertex, outGeometry.vertices[candidate]) < 1.0f)
+							{
+								weldedIndex = candidate;
+								break;
+							}
+					}
+
+			if (weldedIndex == -1)
+			{
+				weldedIndex = (int32_t)outGeometry.vertices.size();
+				outGeometry.vertices.push_back(vertex);
+				int32_t& first = firstInCell.FindOrAdd(cell, -1);
+				nextInCell.push_back(first);
+				first = weldedIndex;
+			}
+
+			outGeometry.indices.push_back(weldedIndex);
+		}
+	}
+
+	size_t BuildMeshColumns(const std::vector<Vector>& triangles, const Vector& vScale, const SweepParams& sweep, Workspace& workspace, std::vector<RayColumn>& outColumns, std::vector<EdgeLink>* outDebugLinks)
+	{
+		const float spacing = sweep.spacing;
+		const float largeOffset = sweep.faceOffset;
+		Workspace::Buffers& buffers = workspace.GetBuffers();
+		Arena& arena = workspace.edgeArena;
+
+		//##### 1. Weld vertices of the triangles #####//
+		WeldedGeometry& geometry = buffers.geometry;
+		WeldTriangleVertices(triangles, workspace, geometry);
+
+		//filter vertices in cover range, minCoverHeight - maxCoverHeight
+		std::vector<int32_t>& verts = buffers.verts;
+		verts.clear();
+
+		for (int32_t vertIndex = 0; vertIndex < (int32_t)geometry.vertices.size(); ++vertIndex)
+			if (geometry.vertices[vertIndex].Z < sweep.fBottom + sweep.maxCover)
+				verts.push_back(vertIndex);
+
+		//sort vertices by height <
+		std::sort(verts.begin(), verts.end(), [&geometry](int32_t A, int32_t B)
+		{
+			const float zA = geometry.vertices[A].Z;
+			const float zB = geometry.vertices[B].Z;
+			return zA != zB ? zA < zB : A < B;
+		});
+
+		//keep only the lowest vertex on the same X and Y axis, vertexOrder is its place in the sorted array (-1 - vertex isn't used)
+		std::vector<int32_t>& vertexOrder = buffers.vertexOrder;
+		vertexOrder.assign(geometry.vertices.size(), -1);
+		CellTable& usedXY = buffers.cellTable;
+		usedXY.Reset(verts.size());
+		int32_t keptVerts = 0;
+
+		for (int32_t vertIndex : verts)
+		{
+			const Vector& vert = geometry.vertices[vertIndex];
+			int32_t& bUsed = usedXY.FindOrAdd({ (int32_t)vert.X, (int32_t)vert.Y, 0 }, 0);
+
+			if (!bUsed)
+			{
+				bUsed = 1;
+				vertexOrder[vertIndex] = keptVerts++;
+			}
+		}
+
+		//##### 2. Create edge links using our filtered vertices #####//
+		std::vector<EdgeLink*>& edgeLinks = buffers.edgeLinks;
+		edgeLinks.clear();
+		CreateEdgeLinks(triangles, geometry, vertexOrder, arena, buffers.edgeCandidates, edgeLinks);
+
+		//##### 3. Columns along every link #####//
+		for (EdgeLink* eLink : edgeLinks)
+		{
+			const float arrowLen = Vector::Dist(eLink->vP1, eLink->vP2) / 2.0f;
+			const Vector middlePoint = eLink->vP1 + eLink->vDirection * arrowLen;
+
+			eLink->vNormal = -(eLink->vNormal); //reverse normal
+			//if object's scale is negative reverse the normal on equivalent axis
+			if (vScale.X < 0.0f) eLink->vNormal = -eLink->vNormal;
+			if (vScale.Y < 0.0f) eLink->vNormal = -eLink->vNormal;
+			if (vScale.Z < 0.0f) eLink->vNormal = -eLink->vNormal;
+
+			if (outDebugLinks)
+				outDebugLinks->push_back(*eLink);
+
+			//Add a small offset to avoid clipping
+			eLink->vP1 += eLink->vDirection * 2.0f;
+			eLink->vP2 -= eLink->vDirection * 2.0f;
+
+			if (Vector::Dist(eLink->vP1, eLink->vP2) > spacing * 2.0f)
+			{
+				const int32_t maxRayCount = int32_t(Vector::Dist(eLink->vP1, eLink->vP2) / spacing);
+
+				for (int32_t offset = 0; offset <= maxRayCount; ++offset)
+				{
+					const float currentSpacing = (float)(offset * spacing);
+					const Vector columnBase = Vector(eLink->vP1.X + eLink->vDirection.X * currentSpacing, eLink->vP1.Y + eLink->vDirection.Y * currentSpacing, 0.0f);
+					outColumns.push_back(RayColumn(columnBase, eLink->vNormal * largeOffset, -eLink->vNormal));
+				}
+			}
+
+			//if distance between two points is < spacing * 2.0f, start ray trace between two points and move up (don't move to the sides)
+			else
+				outColumns.push_back(RayColumn(Vector(middlePoint.X, middlePoint.Y, 0.0f), eLink->vNormal * largeOffset, -eLink->vNormal));
+		}
+
+		//clear edge links as we don't need them anymore (all of them live in the arena)
+		const size_t edgeLinkBytes = arena.GetBytesUsed();
+		arena.Reset();
+		return edgeLinkBytes;
+	}
+
+	void GetColumnRayStarts(const RayColumn& column, const SweepParams& sweep, std::vector<Vector>& outRayStarts)
+	{
+		outRayStarts.clear();
+
+		for (float heightOffset = sweep.minCover; sweep.fBottom + heightOffset <= sweep.fTop; heightOffset += sweep.spacing)
+		{
+			const Vector pos = Vector(column.vBase.X, column.vBase.Y, sweep.fBottom + heightOffset) + column.vOffset;
+
+			//geometry columns can be pushed out of the cover range by their offset
+			if (pos.Z < sweep.fBottom + sweep.minCover || pos.Z > sweep.fBottom + sweep.maxCover)
+				break;
+
+			outRayStarts.push_back(pos);
+		}
+	}
+
+	void ResolveColumn(const RayColumn& column, const SweepParams& sweep, const std::vector<Vector>& rayStarts, IRayQuery& rays, NodeArrays& nodes)
+	{
+		int32_t currentMissCount = 0;
+		NodeHandle currentCoverNode = InvalidNode;
+		RayHit hit;
+
+		for (int32_t rayIndex = 0; rayIndex < (int32_t)rayStarts.size() && currentMissCount <= sweep.missAcceptance; ++rayIndex)
+		{
+			const Vector& pos = rayStarts[rayIndex];
+			const float maxRayDistance = currentCoverNode != InvalidNode ? Vector::Dist(nodes.positions[currentCoverNode], pos) + sweep.spacing : sweep.maxDistance;
+
+			if (rays.Raycast(rayIndex, pos, column.vDirection, maxRayDistance, hit))
+			{
+				//only create the first cover node
+				if (currentCoverNode == InvalidNode)
+					currentCoverNode = nodes.Add(hit.vImpact, hit.vNormal);
+
+				else
+					nodes.heights[currentCoverNode] = hit.vImpact.Z;
+
+				currentMissCount = 0;
+			}
+
+			else
+				currentMissCount++;
+		}
+	}
+
+	void ResolveBisectedColumn(const RayColumn& column, const SweepParams& sweep, const std::vector<Vector>& rayStarts, IRayQuery& rays, NodeArrays& nodes)
+	{
+		NodeHandle currentCoverNode = InvalidNode;
+		RayHit hit;
+
+		//traces a single height step, the first hit creates the node and every other hit can only raise it
+		auto traceStep = [&](int32_t rayIndex) -> bool
+		{
+			const Vector& pos = rayStarts[rayIndex];
+			const float maxRayDistance = currentCoverNode != InvalidNode ? Vector::Dist(nodes.positions[currentCoverNode], pos) + sweep.spacing : sweep.maxDistance;
+
+			if (!rays.Raycast(rayIndex, pos, column.vDirection, maxRayDistance, hit))
+				return false;
+
+			if (currentCoverNode == InvalidNode)
+				currentCoverNode = nodes.Add(hit.vImpact, hit.vNormal);
+
+			else
+				nodes.heights[currentCoverNode] = std::max(nodes.heights[currentCoverNode], hit.vImpact.Z);
+
+			return true;
+		};
+
+		const int32_t rayCount = (int32_t)rayStarts.size();
+
+		//find the bottom of the cover the same way the linear walk does
+		int32_t lowestHit = -1;
+
+		for (int32_t rayIndex = 0; rayIndex < rayCount && rayIndex <= sweep.missAcceptance; ++rayIndex)
+		{
+			if (traceStep(rayIndex))
+			{
+				lowestHit = rayIndex;
+				break;
+			}
+		}
+
+		if (lowestHit == -1)
+			return;
+
+		//most columns are solid up to the top
+		int32_t highestMiss = rayCount;
+
+		if (highestMiss - 1 > lowestHit)
+		{
+			if (traceStep(highestMiss - 1))
+				return;
+
+			highestMiss--;
+		}
+
+		//lowestHit is always cover and highestMiss never is, halve the steps between them until they meet
+		while (highestMiss - lowestHit > 1)
+		{
+			const int32_t middle = (lowestHit + highestMiss) / 2;
+
+			if (traceStep(middle))
+			{
+				lowestHit = middle;
+				continue;
+			}
+
+			//gaps of up to missAcceptance steps don't end the cover, same as with the linear walk
+			int32_t bridgedHit = -1;
+
+			for (int32_t rayIndex = middle + 1; rayIndex < highestMiss && rayIndex <= middle + sweep.missAcceptance; ++rayIndex)
+			{
+				if (traceStep(rayIndex))
+				{
+					bridgedHit = rayIndex;
+					break;
+				}
+			}
+
+			if (bridgedHit != -1)
+				lowestHit = bridgedHit;
+
+			else
+				highestMiss = middle;
+		}
+	}
+
+	void ResolveAnalyticColumn(const RayColumn& column, const SweepParams& sweep, const std::vector<Vector>& rayStarts, IRayQuery& rays, NodeArrays& nodes)
+	{
+		//lowest and highest ray of the column, the same steps GetColumnRayStarts takes
+		Vector vLowest, vHighest;
+		bool bAnyRay = false;
+
+		for (float heightOffset = sweep.minCover; sweep.fBottom + heightOffset <= sweep.fTop; heightOffset += sweep.spacing)
+		{
+			const Vector pos = Vector(column.vBase.X, column.vBase.Y, sweep.fBottom + heightOffset) + column.vOffset;
+
+			if (pos.Z < sweep.fBottom + sweep.minCover || pos.Z > sweep.fBottom + sweep.maxCover)
+				break;
+
+			if (!bAnyRay)
+				vLowest = pos;
+
+			vHighest = pos;
+			bAnyRay = true;
+		}
+
+		if (!bAnyRay)
+			return;
+
+		//every ray of the column would hit the face, the node goes where the lowest one does and the cover is as high as the highest one
+		Vector vPosition = vLowest + column.vDirection * sweep.faceOffset;
+		Vector vNormal = -column.vDirection;
+
+		//lowest ray checks if something is standing in front of the face
+		if (!rayStarts.empty())
+		{
+			RayHit hit;
+
+			if (!rays.Raycast(0, rayStarts[0], column.vDirection, sweep.maxDistance, hit))
+				return;
+
+			vPosition = hit.vImpact;
+			vNormal = hit.vNormal;
+		}
+
+		const NodeHandle coverNode = nodes.Add(vPosition, vNormal);
+		nodes.heights[coverNode] = vHighest.Z;
+	}
+
+	void MergeNodesInProximity(NodeArrays& nodes, Workspace& workspace, float radius, bool bOnlySameNormal)
+	{
+		const std::vector<Vector>& positions = nodes.positions;
+		const std::vector<Vector>& normals = nodes.normals;
+		Workspace::Buffers& buffers = workspace.GetBuffers();
+
+		std::vector<NodeHandle>& testedNodes = buffers.nodeList;
+		std::vector<bool>& bDuplicate = buffers.bNodeMarks;
+		testedNodes.clear();
+		bDuplicate.assign(nodes.Num(), false);
+
+		//only nodes from the neighbouring cells are tested, the result is the same as testing every pair
+		NodeGrid& grid = buffers.grid;
+		grid.Build(nodes, radius, false);
+		std::vector<NodeHandle>& candidates = buffers.candidates;
+
+		for (NodeHandle cNodeCurrent = 0; cNodeCurrent < nodes.Num(); ++cNodeCurrent)
+		{
+			if (bDuplicate[cNodeCurrent])
+				continue;
+
+			grid.GetCandidates(positions[cNodeCurrent], radius, candidates);
+
+			for (NodeHandle cNodeTested : candidates)
+			{
+				//nodes before the current one were already tested against it
+				if (cNodeTested <= cNodeCurrent || bDuplicate[cNodeTested])
+					continue;
+
+				if (Vector::Dist(positions[cNodeCurrent], positions[cNodeTested]) > radius)
+					continue;
+
+				if (!bOnlySameNormal || Vector::Dot(normals[cNodeCurrent], normals[cNodeTested]) > 0.8f)
+					bDuplicate[cNodeTested] = true;
+			}
+
+			testedNodes.push_back(cNodeCurrent);
+		}
+
+		//duplicates are dropped with the reorder
+		nodes.Reorder(testedNodes, buffers.reorderScratch);
+	}
+
+	void MergeNodesInProximity2D(NodeArrays& nodes, Workspace& workspace, float radius)
+	{
+		const std::vector<Vector>& positions = nodes.positions;
+		Workspace::Buffers& buffers = workspace.GetBuffers();
+
+		std::vector<NodeHandle>& testedNodes = buffers.nodeList;
+		std::vector<bool>& bDuplicate = buffers.bNodeMarks;
+		testedNodes.clear();
+		bDuplicate.assign(nodes.Num(), false);
+
+		//nodes have to be on the same floor(Z), so the grid only returns nodes from the same Z unit
+		NodeGrid& grid = buffers.grid;
+		grid.Build(nodes, radius, true);
+		std::vector<NodeHandle>& candidates = buffers.candidates;
+
+		for (NodeHandle cNodeCurrent = 0; cNodeCurrent < nodes.Num(); ++cNodeCurrent)
+		{
+			if (bDuplicate[cNodeCurrent])
+				continue;
+
+			grid.GetCandidates(positions[cNodeCurrent], radius, candidates);
+
+			for (NodeHandle cNodeTested : candidates)
+				if (cNodeTested > cNodeCurrent && !bDuplicate[cNodeTested] && std::floor(positions[cNodeCurrent].Z) == std::floor(positions[cNodeTested].Z))
+					if (Vector::DistXY(positions[cNodeCurrent], positions[cNodeTested]) <= radius)
+						bDuplicate[cNodeTested] = true;
+
+			testedNodes.push_back(cNodeCurrent);
+		}
+
+		nodes.Reorder(testedNodes, buffers.reorderScratch);
+	}
+
+	void RemoveUpAndDownNodes(NodeArrays& nodes, float maxUp)
+	{
+		//compact in place, the order of the remaining nodes doesn't change
+		int32_t kept = 0;
+
+		for (NodeHandle node = 0; node < nodes.Num(); ++node)
+		{
+			if (nodes.normals[node].Z > maxUp || nodes.normals[node].Z < -maxUp)
+				continue;
+
+			nodes.positions[kept] = nodes.positions[node];
+			nodes.normals[kept]   = nodes.normals[node];
+			nodes.heights[kept]   = nodes.heights[node];
+			nodes.flags[kept]     = nodes.flags[node];
+			kept++;
+		}
+
+		nodes.positions.resize(kept);
+		nodes.normals.resize(kept);
+		nodes.heights.resize(kept);
+		nodes.flags.resize(kept);
+	}
+
+	//nodes between firstNode and lastNode are within maxError of the line between them, their heights of the heights interpolated along it
+	static bool FitsProfileLine(const NodeArrays& nodes, NodeHandle firstNode, NodeHandle lastNode, float maxError)
+	{
+		const Vector& vStart = nodes.positions[firstNode];
+		const Vector vLine = nodes.positions[lastNode] - vStart;
+		const float lineSizeSquared = std::max(vLine.SizeSquared(), 1.e-8f);
+		const float heightChange = nodes.heights[lastNode] - nodes.heights[firstNode];
+
+		for (NodeHandle node = firstNode + 1; node < lastNode; ++node)
+		{
+			const float t = std::min(std::max(Vector::Dot(nodes.positions[node] - vStart, vLine) / lineSizeSquared, 0.0f), 1.0f);
+
+			if ((nodes.positions[node] - (vStart + vLine * t)).SizeSquared() > maxError * maxError)
+				return false;
+
+			if (std::abs(nodes.heights[node] - (nodes.heights[firstNode] + heightChange * t)) > maxError)
+				return false;
+		}
+
+		return true;
+	}
+
+	int32_t OptimizeNodes(NodeArrays& nodes, Workspace& workspace, float spacing, float segmentMinNormalDot, OptimizeDebug* outDebug)
+	{
+		if (nodes.Num() == 0)
+			return 0;
+
+		const std::vector<Vector>& positions = nodes.positions;
+		const std::vector<Vector>& normals = nodes.normals;
+		const int32_t numberOfCoverNodes = nodes.Num();
+		Workspace::Buffers& buffers = workspace.GetBuffers();
+
+		std::vector<NodeHandle>& chainedNodes = buffers.nodeList;
+		std::vector<bool>& bChained = buffers.bNodeMarks; //same as searching chainedNodes, without the search
+		chainedNodes.clear();
+		bChained.assign(numberOfCoverNodes, false);
+
+		//the next node of a chain is the closest one (in 0.1 steps) within searchRadius, nodes with the most similar normal win over closer ones
+		const float searchRadius = spacing * 5.0f;
+		const float distanceStep = 0.1f;
+		const float normalTiers[] = { 0.1f, 0.6f, 1.1f, 1.6f, 2.1f }; //2.1 accepts any normal
+		const int32_t tierCount = (int32_t)(sizeof(normalTiers) / sizeof(normalTiers[0]));
+
+		NodeGrid& grid = buffers.grid;
+		grid.Build(nodes, searchRadius, false);
+		std::vector<NodeHandle>& candidates = buffers.candidates;
+
+		NodeHandle nodeZero = 0;
+		nodes.flags[nodeZero] |= NF_MainNode;
+		chainedNodes.push_back(nodeZero);
+		bChained[nodeZero] = true;
+		if (outDebug) outDebug->chainStarts.push_back(positions[nodeZero]);
+
+		NodeHandle firstUnchained = 1; //nodes before it are all chained
+		int32_t chainCount = 1;
+
+		while ((int32_t)chainedNodes.size() < numberOfCoverNodes)
+		{
+			grid.GetCandidates(positions[nodeZero], searchRadius, candidates);
+
+			NodeHandle nextNode = InvalidNode;
+			int32_t nextTier = tierCount;
+			int32_t nextStep = INT_MAX;
+
+			for (NodeHandle currentNode : candidates)
+			{
+				if (bChained[currentNode])
+					continue;
+
+				const float currentDistance = Vector::Dist(positions[nodeZero], positions[currentNode]);
+				if (currentDistance > searchRadius)
+					continue;
+
+				const Vector vNormal = normals[nodeZero] - normals[currentNode];
+				int32_t tier = 0;
+				while (tier < tierCount && !NormalCheck2D(vNormal, normalTiers[tier]))
+					tier++;
+
+				if (tier == tierCount || tier > nextTier)
+					continue;
+
+				//lower handle wins if two nodes are in the same step
+				const int32_t step = (int32_t)std::ceil(currentDistance / distanceStep);
+				if (tier < nextTier || (tier == nextTier && (step < nextStep || (step == nextStep && currentNode < nextNode))))
+				{
+					nextNode = currentNode;
+					nextTier = tier;
+					nextStep = step;
+				}
+			}
+
+			if (nextNode != InvalidNode)
+			{
+				chainedNodes.push_back(nextNode);
+				bChained[nextNode] = true;
+				nodes.flags[nodeZero] |= NF_ConnectedNode;
+				nodeZero = nextNode;
+				continue;
+			}
+
+			//nothing left around the end of the chain, there's a hole in the geometry so a new chain starts at the first node that isn't chained yet
+			while (bChained[firstUnchained])
+				firstUnchained++;
+
+			nodeZero = firstUnchained;
+			nodes.flags[nodeZero] |= NF_MainNode;
+			chainedNodes.push_back(nodeZero);
+			bChained[nodeZero] = true;
+			chainCount++;
+
+			if (outDebug) outDebug->chainStarts.push_back(positions[nodeZero]);
+		}
+
+		//nodes are stored in the chain's order from now on (positions and normals now refer to the reordered arrays)
+		nodes.Reorder(chainedNodes, buffers.reorderScratch);
+		chainedNodes.clear();
+
+		const float minZDifference = 5.0f;
+		const float maxAcceptedDistance = spacing * 2.0f;
+
+		//links of the chain only stay where the next node is close and on the same level, where it faces another way a new segment starts at the corner
+		Vector vSegmentNormals = normals[0];
+
+		for (NodeHandle cNode = 0; cNode < nodes.Num() - 1; ++cNode)
+		{
+			const NodeHandle fNode = cNode + 1;
+
+			if (!(nodes.flags[cNode] & NF_ConnectedNode) || maxAcceptedDistance < Vector::DistXY(positions[cNode], positions[fNode]) || std::abs(positions[fNode].Z - positions[cNode].Z) >= minZDifference)
+			{
+				nodes.flags[cNode] &= ~NF_ConnectedNode;
+				vSegmentNormals = normals[fNode];
+			}
+
+			else if (Vector::Dot(vSegmentNormals.GetSafeNormal(), normals[fNode]) < segmentMinNormalDot)
+			{
+				nodes.flags[cNode] |= NF_MainNode;
+				vSegmentNormals = normals[fNode];
+			}
+
+			else
+				vSegmentNormals += normals[fNode];
+		}
+
+		//Remove unnecessary nodes: a segment keeps its ends and only the nodes its polyline and height profile can't skip
+		const float maxProfileError = spacing / 2.0f;
+		NodeHandle segmentStart = 0;
+
+		for (NodeHandle cNode = 0; cNode < nodes.Num(); ++cNode)
+		{
+			const bool bCorner = cNode > segmentStart && (nodes.flags[cNode] & NF_MainNode) && (nodes.flags[cNode] & NF_ConnectedNode);
+
+			if ((nodes.flags[cNode] & NF_ConnectedNode) && !bCorner)
+				continue;
+
+			//cNode ends the segment, the line from the last kept node is stretched for as long as the nodes it skips stay close to it
+			NodeHandle keptNode = segmentStart;
+
+			for (NodeHandle endNode = segmentStart + 2; endNode <= cNode; ++endNode)
+			{
+				if (FitsProfileLine(nodes, keptNode, endNode, maxProfileError))
+					continue;
+
+				for (NodeHandle node = keptNode + 1; node < endNode - 1; ++node)
+					chainedNodes.push_back(node);
+
+				keptNode = endNode - 1;
+			}
+
+			for (NodeHandle node = keptNode + 1; node < cNode; ++node)
+				chainedNodes.push_back(node);
+
+			segmentStart = bCorner ? cNode : cNode + 1; //the corner is shared by both segments
+		}
+
+		if (outDebug)
+			for (NodeHandle node : chainedNodes)
+				outDebug->removedNodes.push_back(positions[node]);
+
+		nodes.Remove(chainedNodes);
+		return chainCount;
+	}
+
+	void FinalizeHeights(NodeArrays& nodes)
+	{
+		for (NodeHandle node = 0; node < nodes.Num(); ++node)
+			nodes.heights[node] -= nodes.positions[node].Z;
+	}
+
+	void BuildCoverSegments(const NodeArrays& nodes, float slotSpacing, std::vector<CoverSegment>& outSegments)
+	{
+		outSegments.clear();
+		int32_t slotCount = 0;
+
+		for (NodeHandle node = 0; node < nodes.Num(); ++node)
+		{
+			//a node that isn't linked from the previous one starts a segment
+			if (node == 0 || !(nodes.flags[node - 1] & NF_ConnectedNode))
+			{
+				CoverSegment newSegment;
+				newSegment.firstNode = node;
+				outSegments.push_back(newSegment);
+			}
+
+			else
+				outSegments.back().fLength += Vector::Dist(nodes.positions[node - 1], nodes.positions[node]);
+
+			CoverSegment& segment = outSegments.back();
+			segment.nodeCount++;
+			segment.vNormal += nodes.normals[node];
+
+			//a linked corner ends its segment and starts the next one, which faces the way of the nodes after it
+			if (segment.nodeCount > 1 && (nodes.flags[node] & NF_MainNode) && (nodes.flags[node] & NF_ConnectedNode))
+			{
+				CoverSegment newSegment;
+				newSegment.firstNode = node;
+				newSegment.nodeCount = 1;
+				outSegments.push_back(newSegment);
+			}
+		}
+
+		for (CoverSegment& segment : outSegments)
+		{
+			segment.vNormal.Normalize();
+			segment.firstSlot = slotCount;
+			segment.slotCount = 1 + (int32_t)std::lround(segment.fLength / std::max(slotSpacing, 1.0f));
+			slotCount += segment.slotCount;
+		}
+	}
+
+	void GetObjectColumnRayStarts(const RayColumn& column, const SweepParams& sweep, bool bAnalytic, const GenerationSettings& settings, std::vector<Vector>& outRayStarts)
+	{
+		GetColumnRayStarts(column, sweep, outRayStarts);
+
+		if (bAnalytic)
+			outRayStarts.resize(settings.bAnalyticOcclusionTraces ? std::min<size_t>(outRayStarts.size(), 1) : 0);
+	}
+
+	void ResolveObjectColumn(const RayColumn& column, const SweepParams& sweep, const std::vector<Vector>& rayStarts, bool bAnalytic, const GenerationSettings& settings, IRayQuery& rays, NodeArrays& nodes)
+	{
+		if (bAnalytic)
+			ResolveAnalyticColumn(column, sweep, rayStarts, rays, nodes);
+
+		else if (settings.bBisectHeights)
+			ResolveBisectedColumn(column, sweep, rayStarts, rays, nodes);
+
+		else
+			ResolveColumn(column, sweep, rayStarts, rays, nodes);
+	}
+
+	int32_t FinishObjectNodes(NodeArrays& nodes, Workspace& workspace, const SweepParams& sweep, bool bFromGeometry, bool bOptimize, const GenerationSettings& settings, std::vector<CoverSegment>& outSegments, GenerationStats* stats, IPhaseObserver* observer, OptimizeDebug* outOptimizeDebug)
+	{
+		const int32_t nodesCreated = nodes.Num();
+
+		{
+			ScopedPhaseTimer phaseTimer(stats, GP_Merge, observer);
+			MergeNodesInProximity(nodes, workspace, bFromGeometry ? sweep.spacing / 2.0f : sweep.spacing - 1.0f, bFromGeometry);
+		}
+
+		const int32_t mergedNodeCount = nodes.Num();
+
+		{
+			ScopedPhaseTimer phaseTimer(stats, GP_UpDownRemoval, observer);
+			RemoveUpAndDownNodes(nodes, 0.9f);
+		}
+
+		int32_t chainCount = 0;
+
+		if (nodes.Num() > 5 && bOptimize)
+		{
+			ScopedPhaseTimer phaseTimer(stats, GP_Optimization, observer);
+			chainCount = OptimizeNodes(nodes, workspace, sweep.spacing, settings.segmentMinNormalDot, outOptimizeDebug);
+		}
+
+		FinalizeHeights(nodes);
+		BuildCoverSegments(nodes, settings.slotSpacing, outSegments);
+
+		if (stats)
+		{
+			stats->nodesCreated += nodesCreated;
+			stats->nodesMerged  += nodesCreated - mergedNodeCount;
+			stats->nodesRemoved += mergedNodeCount - nodes.Num();
+			stats->segments     += (int32_t)outSegments.size();
+		}
+
+		return chainCount;
+	}
+
+	bool GenerateObjectCover(const ObjectInput& input, const GenerationSettings& settings, IRayQuery& rays, Workspace& workspace, NodeArrays& outNodes, std::vector<CoverSegment>& outSegments, GenerationStats* stats)
+	{
+		outNodes.Clear();
+		outSegments.clear();
+
+		SweepParams sweep;
+		if (!MakeSweepParams(input.vBoundsCenter, input.vBoundsHalfSize, settings.spacing, sweep))
+			return false;
+
+		std::vector<RayColumn>& columns = workspace.columns;
+		columns.clear();
+
+		if (input.bFromGeometry)
+		{
+			ScopedPhaseTimer phaseTimer(stats, GP_EdgeLinks);
+			BuildMeshColumns(input.triangles, input.vScale, sweep, workspace, columns);
+		}
+
+		else
+			BuildBoxColumns(input.vBoundsCenter, input.vBoundsHalfSize, sweep, columns);
+
+		{
+			ScopedPhaseTimer phaseTimer(stats, GP_RaySweeps);
+			std::vector<Vector>& rayStarts = workspace.rayStarts;
+
+			//every column creates at most one node
+			outNodes.Reserve((int32_t)columns.size());
+
+			for (const RayColumn& column : columns)
+			{
+				GetObjectColumnRayStarts(column, sweep, input.bAnalytic, settings, rayStarts);
+				ResolveObjectColumn(column, sweep, rayStarts, input.bAnalytic, settings, rays, outNodes);
+			}
+		}
+
+		FinishObjectNodes(outNodes, workspace, sweep, input.bFromGeometry, input.bOptimize, settings, outSegments, stats);
+		return true;
+	}
+}
@@ -0,0 +1,370 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//Engine-independent part of cover generation: columns from bounding boxes and triangle edges, ray sweeps, merging and optimization of nodes
+//it only sees boxes, triangles and an IRayQuery, so it builds without the engine (CMakeLists.txt), CoverGen is the Unreal adapter around it
+namespace CoverCore
+{
+	//same conventions as FVector (Z up, Normalize leaves tiny vectors untouched)
+	struct Vector
+	{
+		float X, Y, Z;
+
+		Vector() : X(0.0f), Y(0.0f), Z(0.0f) {}
+		Vector(float x, float y, float z) : X(x), Y(y), Z(z) {}
+
+		inline Vector operator+(const Vector& V) const { return Vector(X + V.X, Y + V.Y, Z + V.Z); }
+		inline Vector operator-(const Vector& V) const { return Vector(X - V.X, Y - V.Y, Z - V.Z); }
+		inline Vector operator*(float scale)     const { return Vector(X * scale, Y * scale, Z * scale); }
+		inline Vector operator/(float scale)     const { return Vector(X / scale, Y / scale, Z / scale); }
+		inline Vector operator-()                const { return Vector(-X, -Y, -Z); }
+		inline Vector& operator+=(const Vector& V) { X += V.X; Y += V.Y; Z += V.Z; return *this; }
+		inline Vector& operator-=(const Vector& V) { X -= V.X; Y -= V.Y; Z -= V.Z; return *this; }
+		inline bool operator==(const Vector& V) const { return X == V.X && Y == V.Y && Z == V.Z; }
+		inline bool operator!=(const Vector& V) const { return !(*this == V); }
+		inline float  operator[](int32_t axis) const { return (&X)[axis]; }
+		inline float& operator[](int32_t axis)       { return (&X)[axis]; }
+
+		inline float SizeSquared() const { return X * X + Y * Y + Z * Z; }
+		inline float Size()        const { return std::sqrt(SizeSquared()); }
+
+		inline bool Normalize(float tolerance = 1.e-8f)
+		{
+			const float squareSum = SizeSquared();
+			if (squareSum <= tolerance)
+				return false;
+
+			const float scale = 1.0f / std::sqrt(squareSum);
+			X *= scale; Y *= scale; Z *= scale;
+			return true;
+		}
+
+		inline Vector GetSafeNormal(float tolerance = 1.e-8f) const { Vector normal = *this; return normal.Normalize(tolerance) ? normal : Vector(); }
+
+		static inline float  Dot(const Vector& A, const Vector& B)   { return A.X * B.X + A.Y * B.Y + A.Z * B.Z; }
+		static inline Vector Cross(const Vector& A, const Vector& B) { return Vector(A.Y * B.Z - A.Z * B.Y, A.Z * B.X - A.X * B.Z, A.X * B.Y - A.Y * B.X); }
+		static inline float  Dist(const Vector& A, const Vector& B)  { return (A - B).Size(); }
+		static inline float  DistXY(const Vector& A, const Vector& B) { return std::sqrt((A.X - B.X) * (A.X - B.X) + (A.Y - B.Y) * (A.Y - B.Y)); }
+	};
+
+	//index of a node in its NodeArrays, stays valid until nodes are removed or reordered
+	typedef int32_t NodeHandle;
+	static const NodeHandle InvalidNode = -1;
+
+	enum NodeFlags : uint8_t
+	{
+		NF_None          = 0,
+		NF_ConnectedNode = 1 << 0, //the next node continues the same cover segment, or the next one if this node is a corner
+		NF_MainNode      = 1 << 1, //first node of a chain (there can be multiple chains if there are holes in geometry), or a corner if the previous node is connected to it
+	};
+
+	//nodes of a single object while it's generated, every attribute is stored in its own contiguous array
+	struct NodeArrays
+	{
+		std::vector<Vector>  positions;
+		std::vector<Vector>  normals;
+		std::vector<float>   heights; //Z of the top of the cover until FinalizeHeights, height above the node after it
+		std::vector<uint8_t> flags;   //NodeFlags
+
+		inline int32_t Num() const { return (int32_t)positions.size(); }
+		NodeHandle Add(const Vector& position, const Vector& normal);
+		void Reorder(const std::vector<NodeHandle>& order, NodeArrays& scratch); //keeps only the nodes in order, in that order (built in scratch and swapped, so nothing is allocated once scratch is big enough)
+		void Remove(const std::vector<NodeHandle>& nodesToBeRemoved);            //nodesToBeRemoved is sorted, the rest are compacted in place
+		void Clear();
+		void Reserve(int32_t count);
+	};
+
+	//finished node in 10 bytes: position in 16 bit fixed point relative to its object's origin, octahedral normal, height and flags in one 16 bit word
+	//all nodes of an object share one step (a power of two), PackedNodeFrame holds it together with the origin
+	struct PackedNode
+	{
+		int16_t  position[3];
+		uint16_t normal;         //octahedral, 8 bits per axis
+		uint16_t heightAndFlags; //height in steps in the low 14 bits, NodeFlags in the top 2
+	};
+
+	//run of finished nodes linked by NF_ConnectedNode: a polyline through them with one normal, its height changes linearly from node to node
+	//a corner node is the last node of one segment and the first node of the next one
+	//cover spots along it (slots) are spread evenly from its first node to its last one, about slotSpacing apart
+	struct CoverSegment
+	{
+		int32_t firstNode = 0;
+		int32_t nodeCount = 0; //1 - a node without neighbours, it has a single slot
+		int32_t firstSlot = 0; //slots of all segments of an object are numbered one after another
+		int32_t slotCount = 0;
+		Vector  vNormal;       //average of its nodes' normals
+		float   fLength = 0.0f; //along the polyline
+
+		inline float GetSlotStep() const { return slotCount > 1 ? fLength / (slotCount - 1) : 0.0f; } //distance between two slots along the polyline
+	};
+
+	static_assert(sizeof(PackedNode) == 10, "PackedNode is baked as it is, the baked cover version has to change with it");
+
+	static const uint16_t PackedHeightMask = 0x3FFF;
+	static const int32_t  PackedFlagsShift = 14;
+
+	struct PackedNodeFrame
+	{
+		Vector vOrigin;
+		float  step = 1.0f; //units per fixed point step
+	};
+
+	//smallest step every node of a finished object (heights already above their nodes) fits in around vOrigin
+	PackedNodeFrame MakePackedNodeFrame(const NodeArrays& nodes, const Vector& vOrigin);
+	PackedNode PackNode(const PackedNodeFrame& frame, const Vector& position, const Vector& normal, float height, uint8_t flags);
+	uint16_t EncodeOctahedralNormal(const Vector& normal);
+	Vector DecodeOctahedralNormal(uint16_t encoded);
+
+	inline Vector UnpackPosition(const PackedNodeFrame& frame, const PackedNode& node) { return frame.vOrigin + Vector(node.position[0], node.position[1], node.position[2]) * frame.step; }
+	inline Vector UnpackNormal(const PackedNode& node)                                 { return DecodeOctahedralNormal(node.normal); }
+	inline float  UnpackHeight(const PackedNodeFrame& frame, const PackedNode& node)   { return (node.heightAndFlags & PackedHeightMask) * frame.step; }
+	inline uint8_t UnpackFlags(const PackedNode& node)                                 { return (uint8_t)(node.heightAndFlags >> PackedFlagsShift); }
+
+	//a vertical line of rays shot at an object, from minCover up to the top of its bounding box
+	struct RayColumn
+	{
+		Vector  vBase;      //X & Y of the column (Z is set for every height step)
+		Vector  vOffset;    //added to the ray start after the height is set (geometry columns are pushed out along the edge normal)
+		Vector  vDirection; //direction of every ray in the column
+		int32_t iDebugSide; //side used by cover.Debug.MissedRays, 1 - front, 2 - left, 3 - back, 4 - right, 0 - geometry
+
+		RayColumn(const Vector& Base, const Vector& Offset, const Vector& Direction, int32_t DebugSide = 0) :
+			vBase(Base),
+			vOffset(Offset),
+			vDirection(Direction),
+			iDebugSide(DebugSide)
+		{;}
+	};
+
+	//values shared by all columns of a single object
+	struct SweepParams
+	{
+		float   fBottom        = 0.0f;  //bottom of the bounding box (or ground level if the object clips through the ground)
+		float   fTop           = 0.0f;  //top of the bounding box
+		float   minCover       = 0.0f;
+		float   maxCover       = 0.0f;
+		float   spacing        = 0.0f;
+		int32_t missAcceptance = 0;     //how many rays in a row can miss before we stop going up the column
+		float   maxDistance    = 0.0f;  //ray length used until the column has a cover node
+		float   faceOffset     = 0.0f;  //distance between the column and the face it's shooting at
+	};
+
+	//result of a single ray
+	struct RayHit
+	{
+		Vector vImpact;
+		Vector vNormal;
+		float  fDistance = 0.0f;
+		bool   bHit      = false; //true only if the first blocking hit was the tested object
+	};
+
+	//the world rays are traced against, implemented by the engine (physics scene, BVH of the object) or by MockWorld
+	class IRayQuery
+	{
+	public:
+		virtual ~IRayQuery() {}
+
+		//rayIndex - index of the ray in the column's ray starts, so rays that were traced up front can return their results
+		//a hit on anything but the tested object is a miss
+		virtual bool Raycast(int32_t rayIndex, const Vector& vStart, const Vector& vDirection, float maxDistance, RayHit& outHit) = 0;
+	};
+
+	//bump allocator for short-lived generation data (edge links), everything is released at once with Reset()
+	class Arena
+	{
+	public:
+		Arena(size_t blockSize = 16 * 1024) : _blockSize(blockSize) {}
+		~Arena();
+		Arena(const Arena&) = delete;
+		Arena& operator=(const Arena&) = delete;
+
+		//only for types that don't need a destructor, Reset() doesn't call any
+		template<typename T, typename... ArgsType>
+		T* New(ArgsType&&... args)
+		{
+			static_assert(std::is_trivially_destructible<T>::value, "Arena doesn't call destructors");
+			static_assert(alignof(T) <= alignof(std::max_align_t), "blocks are only aligned to max_align_t");
+			return new(Allocate(sizeof(T), alignof(T))) T(std::forward<ArgsType>(args)...);
+		}
+
+		void*  Allocate(size_t size, size_t alignment);
+		void   Reset(); //keeps the first block for the next object, frees the rest
+		size_t GetBytesUsed()     const { return _bytesUsed; }
+		size_t GetBytesReserved() const;
+
+	private:
+		struct Block
+		{
+			uint8_t* data = nullptr;
+			size_t   size = 0;
+			size_t   used = 0;
+		};
+
+		std::vector<Block> _blocks;
+		size_t _blockSize = 0;
+		size_t _bytesUsed = 0;
+	};
+
+	//two connected vertices of an object's triangles, columns are placed along it
+	struct EdgeLink
+	{
+		Vector vP1;
+		Vector vP2;
+		Vector vNormal;
+		Vector vDirection;
+
+		EdgeLink(const Vector& Point1, const Vector& Point2, const Vector& Normal, const Vector& Direction) :
+			vP1(Point1),
+			vP2(Point2),
+			vNormal(Normal),
+			vDirection(Direction)
+		{;}
+	};
+
+	//triangles of a single object with welded vertices, indices follow the order of the triangle soup (3 per triangle)
+	struct WeldedGeometry
+	{
+		std::vector<Vector>  vertices;
+		std::vector<int32_t> indices;
+	};
+
+	//buffers reused from object to object, once they have grown to fit the largest object generation doesn't allocate
+	//a workspace can only be used by one thread at a time
+	class Workspace
+	{
+	public:
+		Workspace();
+		~Workspace();
+		Workspace(const Workspace&) = delete;
+		Workspace& operator=(const Workspace&) = delete;
+
+		Arena edgeArena;                //edge links of the object whose columns are being built
+		std::vector<RayColumn> columns; //columns of GenerateObjectCover
+		std::vector<Vector> rayStarts;  //rays of the column that is being resolved
+		std::vector<RayHit> hits;       //rays of the column that were traced up front
+		std::vector<CoverSegment> segments; //segments of the object whose nodes were just finished
+
+		struct Buffers; //welding, node grids and reordering, only CoverCore.cpp uses them
+		inline Buffers& GetBuffers() { return *_buffers; }
+
+	private:
+		std::unique_ptr<Buffers> _buffers;
+	};
+
+	//phases of a single object's generation
+	enum GenerationPhase : uint8_t
+	{
+		GP_Geometry,       //triangles of CoverFromGeometry objects
+		GP_EdgeLinks,
+		GP_RaySweeps,
+		GP_Merge,
+		GP_UpDownRemoval,
+		GP_Optimization,
+		GP_OccupancyBoxes, //engine only
+		GP_Count
+	};
+
+	extern const char* const GenerationPhaseNames[GP_Count];
+
+	//counters of a single object, or of everything generated since generation started
+	struct GenerationStats
+	{
+		int32_t raysCast     = 0; //counted by the IRayQuery that traces them
+		int32_t rayHits      = 0; //hits and misses only count results that were used, rays traced up front can be more than that
+		int32_t rayMisses    = 0;
+		int32_t nodesCreated = 0;
+		int32_t nodesMerged  = 0;
+		int32_t nodesRemoved = 0; //by up/down removal and optimization
+		int32_t segments     = 0;
+		double  phaseSeconds[GP_Count] = {};
+		uint64_t phaseAllocations[GP_Count] = {};     //only counted while an allocation counter is set
+		uint64_t phaseAllocatedBytes[GP_Count] = {};
+
+		void Add(const GenerationStats& other);
+		double GetTotalSeconds() const;
+	};
+
+	//heap allocations made by the process so far, the host counts them itself (benchmarks override operator new)
+	struct AllocationCounters
+	{
+		uint64_t allocations = 0;
+		uint64_t bytes       = 0;
+	};
+
+	typedef void (*AllocationCounterFn)(AllocationCounters& outCounters);
+	void SetAllocationCounter(AllocationCounterFn counter); //read at the start and end of every phase, nullptr - allocations aren't counted
+
+	//chain starts and removed nodes of OptimizeNodes, for debug drawing
+	struct OptimizeDebug
+	{
+		std::vector<Vector> chainStarts;  //the first one is the start of the first chain
+		std::vector<Vector> removedNodes;
+	};
+
+	//the engine's profiler scopes around the phases the core runs, GenerationStats gets their time either way
+	class IPhaseObserver
+	{
+	public:
+		virtual ~IPhaseObserver() {}
+		virtual void OnPhaseStarted(GenerationPhase phase) = 0;
+		virtual void OnPhaseFinished(GenerationPhase phase) = 0;
+	};
+
+	//Columns
+	bool MakeSweepParams(const Vector& vBoundsCenter, const Vector& vBoundsHalfSize, float spacing, SweepParams& outSweep); //false - object isn't tall enough to give cover
+	void BuildBoxColumns(const Vector& vBoundsCenter, const Vector& vBoundsHalfSize, const SweepParams& sweep, std::vector<RayColumn>& outColumns); //columns around the bounding box, shooting at its faces
+	void WeldTriangleVertices(const std::vector<Vector>& triangles, Workspace& workspace, WeldedGeometry& outGeometry); //vertices closer than 1 unit become one vertex
+	size_t BuildMeshColumns(const std::vector<Vector>& triangles, const Vector& vScale, const SweepParams& sweep, Workspace& workspace, std::vector<RayColumn>& outColumns, std::vector<EdgeLink>* outDebugLinks = nullptr); //columns along the edges of the lowest vertices, returns the arena bytes the edge links needed
+	void GetColumnRayStarts(const RayColumn& column, const SweepParams& sweep, std::vector<Vector>& outRayStarts);
+
+	//Ray sweeps, rayStarts are the rays of the column that can be traced (GetColumnRayStarts)
+	void ResolveColumn(const RayColumn& column, const SweepParams& sweep, const std::vector<Vector>& rayStarts, IRayQuery& rays, NodeArrays& nodes);         //walks up the column until missAcceptance rays in a row miss
+	void ResolveBisectedColumn(const RayColumn& column, const SweepParams& sweep, const std::vector<Vector>& rayStarts, IRayQuery& rays, NodeArrays& nodes); //same cover with fewer rays, the top is found by bisection
+	void ResolveAnalyticColumn(const RayColumn& column, const SweepParams& sweep, const std::vector<Vector>& rayStarts, IRayQuery& rays, NodeArrays& nodes); //face is known to fill the column, rayStarts is at most its lowest ray (occlusion check)
+
+	//Post-processing
+	void MergeNodesInProximity(NodeArrays& nodes, Workspace& workspace, float radius, bool bOnlySameNormal = true);
+	void MergeNodesInProximity2D(NodeArrays& nodes, Workspace& workspace, float radius); //only nodes on the same floor(Z) are merged
+	void RemoveUpAndDownNodes(NodeArrays& nodes, float maxUp = 0.8f); //nodes whose normal faces too much up or down aren't valid cover
+	int32_t OptimizeNodes(NodeArrays& nodes, Workspace& workspace, float spacing, float segmentMinNormalDot, OptimizeDebug* outDebug = nullptr); //chains the nodes, splits the chains into segments and drops the nodes their profile can skip, returns the number of chains
+	void FinalizeHeights(NodeArrays& nodes); //heights become the height above the node
+	void BuildCoverSegments(const NodeArrays& nodes, float slotSpacing, std::vector<CoverSegment>& outSegments); //finished nodes, slots are about slotSpacing apart
+
+	//Whole objects (CoverGen runs the same steps column by column spread over its scheduler)
+	struct ObjectInput
+	{
+		Vector vBoundsCenter;
+		Vector vBoundsHalfSize;
+		Vector vScale = Vector(1.0f, 1.0f, 1.0f); //only the signs are used, negative scale flips the triangles' normals
+		std::vector<Vector> triangles;             //world space triangle soup (3 vertices per triangle), used if bFromGeometry is set
+		bool bFromGeometry = false;
+		bool bOptimize     = true;
+		bool bAnalytic     = false; //single axis aligned box that fills its bounding box, nodes are placed on its faces
+	};
+
+	struct GenerationSettings
+	{
+		float spacing = 20.0f;
+		bool  bBisectHeights = false;
+		bool  bAnalyticOcclusionTraces = true;
+		float segmentMinNormalDot = 0.95f; //nodes of a segment face at most this far apart from its normal so far (0.95 - about 18 degrees)
+		float slotSpacing = 100.0f;        //distance between the slots of a segment, about one agent wide
+	};
+
+	void GetObjectColumnRayStarts(const RayColumn& column, const SweepParams& sweep, bool bAnalytic, const GenerationSettings& settings, std::vector<Vector>& outRayStarts); //rays that actually have to be traced, analytic columns trace at most their lowest ray
+	void ResolveObjectColumn(const RayColumn& column, const SweepParams& sweep, const std::vector<Vector>& rayStarts, bool bAnalytic, const GenerationSettings& settings, IRayQuery& rays, NodeArrays& nodes); //analytic, bisected or walked up
+	int32_t FinishObjectNodes(NodeArrays& nodes, Workspace& workspace, const SweepParams& sweep, bool bFromGeometry, bool bOptimize, const GenerationSettings& settings, std::vector<CoverSegment>& outSegments, GenerationStats* stats = nullptr, IPhaseObserver* observer = nullptr, OptimizeDebug* outOptimizeDebug = nullptr); //merge, up/down removal, optimization, final heights and segments, returns the number of chains (0 - not optimized)
+
+	//generates cover of a single object on the calling thread, returns false if the object can't give cover
+	bool GenerateObjectCover(const ObjectInput& input, const GenerationSettings& settings, IRayQuery& rays, Workspace& workspace, NodeArrays& outNodes, std::vector<CoverSegment>& outSegments, GenerationStats* stats = nullptr);
+}
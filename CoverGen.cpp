@@ -2,11 +2,15 @@
 
 
 #include "CoverGen.h"
+#include "CoverActorListener.h"
 #include "Engine/Level.h"
 #include "GameFramework/Actor.h"
 #include "Components/BoxComponent.h"
+#include "Components/StaticMeshComponent.h"
 #include "PhysicsEngine/BodySetup.h"
-#include "DrawDebugHelpers.h"
+#include "Components/LineBatchComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
 
 #include "Engine/StaticMesh.h"
 #include "StaticMeshResources.h"
@@ -15,484 +19,2356 @@
 #include "PhysicsPublic.h"
 #include "PhysXIncludes.h"
 #include "PhysXPublic.h"
-#include "Engine/TriggerBox.h"
+#include "EngineUtils.h"
+#include "GameFramework/Pawn.h"
+#include "Async/ParallelFor.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/PlatformFilemanager.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "Misc/Paths.h"
+#include "Algo/Sort.h"
+#include "Algo/BinarySearch.h"
 //#include "ThirdParty/PhysX/PhysX-3.3/include/geometry/PxTriangleMesh.h"
 //#include "ThirdParty/PhysX/PhysX-3.3/include/foundation/PxSimpleTypes.h"
 
-// 0 - OFF, 1 - Draw Cover Nodes, 2 - Draw Cover Nodes & Reconstructed Triangles, 3 - Draw Reconstructed Triangles
-#define VisualDebug 2
-#define DebugMode
-//  0 - OFF, 1 - Draw front, 2 - Draw left, 3 - Draw back, 4 - Draw right, 5 - Draw all
-#define DrawMissedRays 0
+//Debug drawing, categories can be switched at runtime, nothing is recorded or drawn while all of them are 0
+static TAutoConsoleVariable<int32> CVarCoverDebugNodes(TEXT("cover.Debug.Nodes"), 0, TEXT("Draw cover nodes with their normal and height (static - blue, dynamic - green)."));
+static TAutoConsoleVariable<int32> CVarCoverDebugLinks(TEXT("cover.Debug.Links"), 0, TEXT("Draw links between connected cover nodes."));
+static TAutoConsoleVariable<int32> CVarCoverDebugOptimization(TEXT("cover.Debug.Optimization"), 0, TEXT("Draw chain starts and nodes removed by the optimization of cover generated while it's on."));
+static TAutoConsoleVariable<int32> CVarCoverDebugGeometry(TEXT("cover.Debug.Geometry"), 0, TEXT("Draw edge links of CoverFromGeometry actors prepared while it's on."));
+static TAutoConsoleVariable<int32> CVarCoverDebugMissedRays(TEXT("cover.Debug.MissedRays"), 0, TEXT("Draw rays of columns traced while it's on. 0 - off, 1 - front, 2 - left, 3 - back, 4 - right, 5 - all"));
+static TAutoConsoleVariable<int32> CVarCoverDebugOccupancy(TEXT("cover.Debug.Occupancy"), 0, TEXT("Draw occupancy boxes."));
+static TAutoConsoleVariable<float> CVarCoverDebugDrawDistance(TEXT("cover.Debug.DrawDistance"), 5000.0f, TEXT("Cover debug shapes further than this from the camera aren't drawn."));
+
+//Generation stats, "stat CoverGen" in the console, phases also show up as Unreal Insights scopes
+DECLARE_STATS_GROUP(TEXT("CoverGen"), STATGROUP_CoverGen, STATCAT_Advanced);
+DECLARE_CYCLE_STAT(TEXT("Geometry extraction"), STAT_CoverGen_Geometry, STATGROUP_CoverGen);
+DECLARE_CYCLE_STAT(TEXT("Edge linking"), STAT_CoverGen_EdgeLinks, STATGROUP_CoverGen);
+DECLARE_CYCLE_STAT(TEXT("Ray sweeps"), STAT_CoverGen_RaySweeps, STATGROUP_CoverGen);
+DECLARE_CYCLE_STAT(TEXT("Merge"), STAT_CoverGen_Merge, STATGROUP_CoverGen);
+DECLARE_CYCLE_STAT(TEXT("Up/down removal"), STAT_CoverGen_UpDownRemoval, STATGROUP_CoverGen);
+DECLARE_CYCLE_STAT(TEXT("Optimization"), STAT_CoverGen_Optimization, STATGROUP_CoverGen);
+DECLARE_CYCLE_STAT(TEXT("Occupancy boxes"), STAT_CoverGen_OccupancyBoxes, STATGROUP_CoverGen);
+DECLARE_CYCLE_STAT(TEXT("Trace batches"), STAT_CoverGen_TraceBatches, STATGROUP_CoverGen);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Objects generated"), STAT_CoverGen_Objects, STATGROUP_CoverGen);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Rays cast"), STAT_CoverGen_RaysCast, STATGROUP_CoverGen);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Ray hits"), STAT_CoverGen_RayHits, STATGROUP_CoverGen);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Ray misses"), STAT_CoverGen_RayMisses, STATGROUP_CoverGen);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Nodes created"), STAT_CoverGen_NodesCreated, STATGROUP_CoverGen);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Nodes merged"), STAT_CoverGen_NodesMerged, STATGROUP_CoverGen);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Nodes removed"), STAT_CoverGen_NodesRemoved, STATGROUP_CoverGen);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Failed cover claims"), STAT_CoverGen_FailedClaims, STATGROUP_CoverGen);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Segments"), STAT_CoverGen_Segments, STATGROUP_CoverGen);
+
+//CoverCore works with its own vectors, both are three floats
+static inline CoverCore::Vector ToCoreVector(const FVector& vector) { return CoverCore::Vector(vector.X, vector.Y, vector.Z); }
+static inline FVector ToFVector(const CoverCore::Vector& vector)    { return FVector(vector.X, vector.Y, vector.Z); }
+
+//adds the time until the end of the scope to a phase of the object
+struct CoverPhaseTimer
+{
+	double& seconds;
+	double  startTime;
+
+	CoverPhaseTimer(double& phaseSeconds) : seconds(phaseSeconds), startTime(FPlatformTime::Seconds()) {}
+	~CoverPhaseTimer() { seconds += FPlatformTime::Seconds() - startTime; }
+};
+
+#define COVER_PHASE_SCOPE(work, phase) \
+	SCOPE_CYCLE_COUNTER(STAT_CoverGen_##phase); \
+	TRACE_CPUPROFILER_EVENT_SCOPE(CoverGen_##phase); \
+	CoverPhaseTimer phaseTimer##phase((work)->stats.phaseSeconds[CoverCore::GP_##phase])
+
+//same stats and Insights scopes for the phases CoverCore runs, it times them into the object's stats itself
+class CoverPhaseScopes : public CoverCore::IPhaseObserver
+{
+public:
+	virtual void OnPhaseStarted(CoverCore::GenerationPhase phase) override
+	{
+#if STATS
+		_cycleCounters[phase].Start(GetPhaseStatId(phase));
+#endif
+#if CPUPROFILERTRACE_ENABLED
+		FCpuProfilerTrace::OutputBeginDynamicEvent(CoverCore::GenerationPhaseNames[phase]);
+#endif
+	}
+
+	virtual void OnPhaseFinished(CoverCore::GenerationPhase phase) override
+	{
+#if CPUPROFILERTRACE_ENABLED
+		FCpuProfilerTrace::OutputEndEvent();
+#endif
+#if STATS
+		_cycleCounters[phase].Stop();
+#endif
+	}
+
+private:
+#if STATS
+	static TStatId GetPhaseStatId(CoverCore::GenerationPhase phase)
+	{
+		switch (phase)
+		{
+		case CoverCore::GP_Merge:          return GET_STATID(STAT_CoverGen_Merge);
+		case CoverCore::GP_UpDownRemoval:  return GET_STATID(STAT_CoverGen_UpDownRemoval);
+		case CoverCore::GP_Optimization:   return GET_STATID(STAT_CoverGen_Optimization);
+		default:                           return TStatId(); //timed by COVER_PHASE_SCOPE
+		}
+	}
+
+	FCycleCounter _cycleCounters[CoverCore::GP_Count];
+#endif
+};
+
+//Baked cover file: header, object table, cover segments and packed nodes (used in place by the node stores while the file is mapped), object names (UTF-8)
+static const uint32 BakedCoverMagic   = 0x42525643; // "CVRB"
+static const uint32 BakedCoverVersion = 4;
+static const uint32 BakedCoverNodeSize = sizeof(CoverCore::PackedNode);
+static const uint32 BakedCoverSegmentSize = sizeof(CoverCore::CoverSegment);
+
+//Local geometry traces: triangles per BVH leaf and rays per packet (one SIMD register)
+static const int32 GeometryLeafSize = 4;
+static const int32 GeometryPacketSize = 4;
+
+//Cover occupancy: cell size of the grid pawns are looked up in, boxes are registered in every cell they could touch a pawn in
+static const float OccupancyCellSize = 500.0f;
+static const float OccupancyPawnMargin = 100.0f; //more than the radius of any pawn's collision
+
+struct BakedCoverHeader
+{
+	uint32 magic;
+	uint32 version;
+	uint32 nodeSize;    //BakedCoverNodeSize when the file was baked, the file has to be baked again if it changes
+	uint32 segmentSize; //BakedCoverSegmentSize, same as nodeSize
+	int32  objectCount;
+	int32  nodeCount;
+	int32  segmentCount;
+	int32  nameBytes;
+};
+
+struct BakedCoverObject
+{
+	int32   id;
+	int32   firstNode;
+	int32   nodeCount;
+	int32   firstSegment;
+	int32   segmentCount;
+	int32   nameOffset;
+	int32   nameLength;
+	int32   bDynamic;
+	FVector location;
+	FVector size;
+	FVector scale;
+	FVector nodeOrigin; //frame the nodes were packed in
+	float   nodeStep;
+};
 
 //TODO: Turn into a singleton
-CoverGen::CoverGen(UWorld* worldPtr) : _pWorld(worldPtr)
+CoverGen::CoverGen(UWorld* worldPtr, const CoverGenSettings& settings) : _pWorld(worldPtr), _settings(settings)
 {
+	if (_pWorld && _settings.bIncrementalUpdates)
+	{
+		_actorListener = NewObject<UCoverActorListener>();
+		_actorListener->AddToRoot(); //CoverGen isn't a UObject so we have to keep the listener alive ourselves
+		_actorListener->coverGen = this;
+
+		_actorSpawnedHandle = _pWorld->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateRaw(this, &CoverGen::OnActorSpawned));
+	}
+
+	allCoverObjects = new CoverObjects();
+
+	if (!_settings.statsCsvPath.IsEmpty())
+	{
+		FString header = TEXT("Object,Nodes,RaysCast,RayHits,RayMisses,NodesCreated,NodesMerged,NodesRemoved,Segments");
+
+		for (const char* phaseName : CoverCore::GenerationPhaseNames)
+			header += FString::Printf(TEXT(",%sMs"), ANSI_TO_TCHAR(phaseName));
+
+		header += TEXT(",TotalMs\n");
+
+		if (!FFileHelper::SaveStringToFile(header, *_settings.statsCsvPath))
+			UE_LOG(LogTemp, Warning, TEXT("Couldn't write cover stats to %s"), *_settings.statsCsvPath);
+	}
+	_claims = MakeShared<CoverClaimTable, ESPMode::ThreadSafe>(_settings.maxCoverClaims, FPlatformTime::Seconds());
+	UpdateDebugDrawEnabledMask(); //the sink only runs once a variable changes, generation below already records shapes
+
+	if (_pWorld && _settings.bFollowLevelStreaming)
+	{
+		_levelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddRaw(this, &CoverGen::OnLevelAdded);
+		_levelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddRaw(this, &CoverGen::OnLevelRemoved);
+
+		//levels that are already visible won't be added again
+		for (ULevel* level : _pWorld->GetLevels())
+			if (level && level->bIsVisible)
+				GenerateCoverPoints(level, 20.0f);
+	}
+
 	//GetActorsWithCoverFlagInTheScene();
-	GenerateCoverPoints(0, 20.0f);
+	else if (_pWorld)
+		GenerateCoverPoints(_pWorld->PersistentLevel, 20.0f);
 }
 
 CoverGen::~CoverGen()
 {
+	if (_actorListener)
+	{
+		_pWorld->RemoveOnActorSpawnedHandler(_actorSpawnedHandle);
+
+		TArray<uint32> trackedActorIDs;
+		_trackedActors.GetKeys(trackedActorIDs);
+
+		for (uint32 actorUniqueID : trackedActorIDs)
+			UntrackActor(actorUniqueID);
+
+		_actorListener->coverGen = nullptr;
+		_actorListener->RemoveFromRoot();
+		_actorListener = nullptr;
+	}
+
+	FWorldDelegates::LevelAddedToWorld.Remove(_levelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(_levelRemovedHandle);
+
+	//callbacks of unfinished queries are dropped, their agents could be gone already
+	if (_runningQueryBatch)
+	{
+		FTaskGraphInterface::Get().WaitUntilTaskCompletes(_runningQueryBatch->task);
+		delete _runningQueryBatch;
+		_runningQueryBatch = nullptr;
+	}
+
+	if (_debugDraw)
+	{
+		_debugDraw->UnregisterComponent();
+		_debugDraw->RemoveFromRoot();
+		_debugDraw = nullptr;
+	}
+
+	for (CoverWorkItem* work : _pendingWork)
+		delete work;
+
+	_pendingWork.Empty();
+	_inFlightColumns.Empty();
+
+	for (CoverCore::Workspace* workspace : _allWorkspaces)
+		delete workspace;
+
+	_allWorkspaces.Empty();
+	_freeWorkspaces.Empty();
+
+	if (allCoverObjects)
+	{
+		for (CoverObject* coverObject : allCoverObjects->DynamicCoverObjects)
+			delete coverObject;
+
+		for (CoverObject* coverObject : allCoverObjects->StaticCoverObjects)
+			delete coverObject;
+
+		delete allCoverObjects;
+		allCoverObjects = nullptr;
+	}
+
+	//cover objects can point into the baked files so they have to be released last
+	for (TPair<ULevel*, LevelCover*>& levelPair : _levels)
+	{
+		ReleaseBakedCover(levelPair.Value);
+		delete levelPair.Value;
+	}
+
+	_levels.Empty();
+}
+
+void CoverGen::GenerateCoverPoints(ULevel* level, float spacing)
+{
+	if (!level || _levels.Contains(level))
+		return;
+
+	LevelCover* levelCover = new LevelCover();
+	levelCover->bakedCoverPath = GetBakedCoverPath(level);
+	_levels.Add(level, levelCover);
+	_spacing = spacing;
+
+	const double loadStartTime = FPlatformTime::Seconds();
+
+	if (_settings.bLoadBakedCover && LoadBakedCover(levelCover))
+	{
+		UE_LOG(LogTemp, Log, TEXT("Loaded baked cover from %s in %.4f s"), *levelCover->bakedCoverPath, FPlatformTime::Seconds() - loadStartTime);
+
+		//baked objects don't know their actors, match them by name so changes to those actors can be tracked
+		if (_settings.bIncrementalUpdates)
+		{
+			TMap<FString, CoverObject*> bakedObjectsByName;
+
+			for (CoverObject* coverObject : levelCover->coverObjects)
+				bakedObjectsByName.Add(coverObject->_Name, coverObject);
+
+			for (AActor* actor : level->Actors)
+			{
+				if (!actor || actor->ActorHasTag("NoCover"))
+					continue;
+
+				TrackActor(actor);
+
+				if (CoverObject** coverObject = bakedObjectsByName.Find(actor->GetName()))
+					_trackedActors[actor->GetUniqueID()].coverObject = *coverObject;
+			}
+		}
+
+		return;
+	}
+
+	levelCover->bNeedsBake = _settings.bBakeCover;
+
+	//previous levels are done, start counting the progress again
+	if (IsGenerationFinished())
+	{
+		_actorsToPrepare.Empty();
+		_nextActorToPrepare = 0;
+		_actorsFinished = 0;
+		_generationStartTime = loadStartTime;
+		_generationStats = CoverGenStats();
+	}
+
+	//actors are prepared in this order, so IDs don't depend on how the work is scheduled
+	for (AActor* actor : level->Actors)
+		_actorsToPrepare.Add(actor);
+
+	_bGenerationReported = false;
+
+	//without a frame budget or batched traces everything is generated right now
+	if (!_settings.bBatchedTraces && _settings.frameBudgetMs <= 0.0f)
+		RunScheduledWork(0.0);
+}
+
+float CoverGen::GetGenerationProgress() const
+{
+	if (_actorsToPrepare.Num() == 0)
+		return 1.0f;
+
+	return (float)_actorsFinished / (float)_actorsToPrepare.Num();
+}
+
+int32 CoverGen::QueryCover(const CoverQuery& query, TArray<CoverNodeRef>& outNodes)
+{
+	if (_bQueryIndexDirty)
+		RebuildQueryIndex();
+
+	RunCoverQuery(*_queryIndex, _claims.Get(), query, outNodes);
+	return outNodes.Num();
+}
+
+void CoverGen::QueueCoverQuery(const CoverQuery& query, CoverQueryCallback onFinished)
+{
+	_queuedQueries.queries.Add(query);
+	_queuedQueries.callbacks.Add(MoveTemp(onFinished));
 }
 
-void CoverGen::GenerateCoverPoints(int32 levelIndex, float spacing)
+void CoverGen::StartQueryBatch()
 {
-	if (_pWorld)
+	if (_queuedQueries.queries.Num() == 0 || _runningQueryBatch)
+		return;
+
+	if (_bQueryIndexDirty)
+		RebuildQueryIndex();
+
+	CoverQueryBatch* batch = new CoverQueryBatch(MoveTemp(_queuedQueries));
+	_queuedQueries = CoverQueryBatch();
+	batch->index = _queryIndex;
+	batch->claims = _claims;
+	batch->results.SetNum(batch->queries.Num());
+
+	//queries close to each other read the same cells, run them one after another
+	const CoverQueryIndex& index = *batch->index;
+	TArray<FIntPoint> queryCells;
+	batch->order.SetNumUninitialized(batch->queries.Num());
+
+	for (int32 queryIndex = 0; queryIndex < batch->queries.Num(); ++queryIndex)
 	{
-		ULevel* level = _pWorld->GetLevel(levelIndex);
-		TArray<AActor*> allActors = level->Actors;
-		allCoverObjects = new CoverObjects();
+		queryCells.Add(index.GetCell(batch->queries[queryIndex].vOrigin));
+		batch->order[queryIndex] = queryIndex;
+	}
 
-		for (AActor* actor : allActors)
+	Algo::Sort(batch->order, [&queryCells](int32 A, int32 B)
+	{
+		if (queryCells[A].X != queryCells[B].X) return queryCells[A].X < queryCells[B].X;
+		if (queryCells[A].Y != queryCells[B].Y) return queryCells[A].Y < queryCells[B].Y;
+		return A < B;
+	});
+
+	//the batch only reads its own copy of the index, the game thread can keep changing cover in the meantime
+	batch->task = FFunctionGraphTask::CreateAndDispatchWhenReady([batch]()
+	{
+		ParallelFor(batch->order.Num(), [batch](int32 orderIndex)
 		{
-			if (actor->ActorHasTag("NoCover"))
-				continue;
+			const int32 queryIndex = batch->order[orderIndex];
+			RunCoverQuery(*batch->index, batch->claims.Get(), batch->queries[queryIndex], batch->results[queryIndex]);
+		});
+	}, TStatId(), nullptr, ENamedThreads::AnyBackgroundThreadNormalTask);
+
+	_runningQueryBatch = batch;
+}
+
+void CoverGen::FinishQueryBatch()
+{
+	if (!_runningQueryBatch)
+		return;
+
+	//the batch was started on the previous tick, so it's normally done already
+	CoverQueryBatch* batch = _runningQueryBatch;
+	_runningQueryBatch = nullptr;
+	FTaskGraphInterface::Get().WaitUntilTaskCompletes(batch->task);
+
+	for (int32 queryIndex = 0; queryIndex < batch->queries.Num(); ++queryIndex)
+		if (batch->callbacks[queryIndex])
+			batch->callbacks[queryIndex](batch->results[queryIndex]);
+
+	delete batch;
+}
+
+void CoverGen::RunCoverQuery(const CoverQueryIndex& index, CoverClaimTable* claims, const CoverQuery& query, TArray<CoverNodeRef>& outNodes)
+{
+	outNodes.Reset();
+
+	if (query.maxResults <= 0 || query.fRadius <= 0.0f)
+		return;
+
+	//score of every result, lower is better (distance to the origin, plus how far the threat is from being straight behind the cover)
+	TArray<float, TInlineAllocator<16>> scores;
+	const float radiusSquared = query.fRadius * query.fRadius;
+	const FIntPoint minCell = index.GetCell(query.vOrigin - FVector(query.fRadius));
+	const FIntPoint maxCell = index.GetCell(query.vOrigin + FVector(query.fRadius));
+
+	for (int32 x = minCell.X; x <= maxCell.X; ++x)
+	{
+		for (int32 y = minCell.Y; y <= maxCell.Y; ++y)
+		{
+			const FIntPoint* cell = index.cells.Find(FIntPoint(x, y));
 
-			const float testAboveZ = 226.0f; //226.0f; ??????????????????????
-			const float   fTopOfTheBoundingBox = actor->GetComponentsBoundingBox().GetCenter().Z + actor->GetComponentsBoundingBox().GetSize().Z / 2.0f;
+			if (!cell)
+				continue;
 
-			if(actor->GetActorEnableCollision() && fTopOfTheBoundingBox >= testAboveZ)
+			for (int32 cellEntry = cell->X; cellEntry < cell->X + cell->Y; ++cellEntry)
 			{
-				CoverObject* ptrCurrentCoverObject = new CoverObject();
-				ptrCurrentCoverObject->SetLocation(actor->GetComponentsBoundingBox().GetCenter());//set location
-				ptrCurrentCoverObject->SetSize(actor->GetComponentsBoundingBox().GetSize());//set size
-				ptrCurrentCoverObject->_Name = actor->GetName();//set name
-				ptrCurrentCoverObject->_ID = allCoverObjects->DynamicCoverObjects.Num() + allCoverObjects->StaticCoverObjects.Num();
-				ptrCurrentCoverObject->_vScale = actor->GetActorScale();
-
-				const float minCover = 50.0f;
-				const float maxCover = 180.0f;
-				const float groundLevel = 130.0f;
-
-				const float SmallOffset = 1.0f;
-				const float LargeOffset = 100.0f; // how far away from the bounding box/geometry we want to shoot the ray from (lowering it can help with narrow spaces)
-
-				const int missAcceptance = 2;
-				const float maxDistance = LargeOffset + spacing + 200.0f;
-
-				const FVector boundingBoxCenter = actor->GetComponentsBoundingBox().GetCenter();
-				const FVector sizeHalfed = actor->GetComponentsBoundingBox().GetSize() / 2.0f;
-				bool objectClipsThroughGorund = (boundingBoxCenter.Z - sizeHalfed.Z) < groundLevel;
-				const float   fBottomOfTheBoundingBox = objectClipsThroughGorund ? groundLevel : boundingBoxCenter.Z - sizeHalfed.Z; // to calculate how far up we can go
-				
-				// is cover static or dynamic?
-				// Dynamic cover
-				if (actor->IsRootComponentMovable())
-					allCoverObjects->DynamicCoverObjects.Add(ptrCurrentCoverObject);
-
-				// Static cover
-				else
-					allCoverObjects->StaticCoverObjects.Add(ptrCurrentCoverObject);
-
-
-				//Start cover generation:
-				//OPTION 1 -  use object's geometry for cover generation
-				if (actor->ActorHasTag("CoverFromGeometry"))
+				const CoverIndexEntry& entry = index.entries[index.cellEntries[cellEntry]];
+
+				//the edge is in other cells of the query as well
+				if (FMath::Max(entry.minCell.X, minCell.X) != x || FMath::Max(entry.minCell.Y, minCell.Y) != y)
+					continue;
+
+				//slot closest to the origin first, then its neighbours until they are out of the radius
+				const FVector vEdge = entry.vEnd - entry.vStart;
+				const float edgeLength = entry.fEndDistance - entry.fStartDistance;
+				const float closestAlong = edgeLength > KINDA_SMALL_NUMBER ? FMath::Clamp(FVector::DotProduct(query.vOrigin - entry.vStart, vEdge) / edgeLength, 0.0f, edgeLength) : 0.0f;
+				const int32 closestSlot = entry.fSlotStep > 0.0f ? FMath::Clamp(entry.segmentFirstSlot + FMath::RoundToInt((entry.fStartDistance + closestAlong) / entry.fSlotStep), entry.firstSlot, entry.lastSlot) : entry.firstSlot;
+
+				//false once the slot is too far away to be a result, slots further along the edge are even further
+				auto AddSlot = [&](int32 slot)
 				{
-					//DEBUG DRAW SPHERE OVER "CoverFromGeometry" OBJECT
-					FVector DebugSpherePos = actor->GetComponentsBoundingBox().GetCenter();
-					DebugSpherePos.Z += actor->GetComponentsBoundingBox().GetSize().Z / 2.0f + 50.0f;
-					DrawDebugSphere(_pWorld, DebugSpherePos, 10.0f, 2, FColor::White, true);
+					const float along = (slot - entry.segmentFirstSlot) * entry.fSlotStep - entry.fStartDistance;
+					const float alpha = edgeLength > KINDA_SMALL_NUMBER ? FMath::Clamp(along / edgeLength, 0.0f, 1.0f) : 0.0f;
+					const FVector vPosition = FMath::Lerp(entry.vStart, entry.vEnd, alpha);
+					const float distanceSquared = FVector::DistSquared(vPosition, query.vOrigin);
+
+					if (distanceSquared > radiusSquared)
+						return false;
 
+					float score = FMath::Sqrt(distanceSquared) / query.fRadius;
 
-					//##### 1. Retrieve geometry data #####//
+					if (outNodes.Num() == query.maxResults && score >= scores.Last())
+						return false;
 
-					//# 1a. Retrieve triangles #//
-					const TArray<FVector> scaledTris = ReconstructAndScaleActorTriangles(actor);
+					if (FMath::Lerp(entry.fStartHeight, entry.fEndHeight, alpha) < query.fMinHeight)
+						return true;
 
-					//# 1b. Retrieve vertices #//
-					TArray<FVector> allVerts = GetActorsVertexPositon(actor);
-					TArray<FVector> verts;
+					CoverNodeRef nodeRef;
+					nodeRef.objectID = entry.objectID;
+					nodeRef.node     = slot;
 
-					//filter vertices in cover range, minCoverHeight - maxCoverHeight
-					for (FVector vert : allVerts)
+					if (query.claimantID != 0 && claims->IsClaimed(nodeRef, query.claimantID))
+						return true;
+
+					//normal points away from the cover, so the threat has to be on the other side of it
+					if (query.bHasThreat)
 					{
-						if (vert.Z < fBottomOfTheBoundingBox + maxCover)
-						{
-							verts.Add(vert);
-						}
+						const float threatDot = -FVector::DotProduct(entry.vNormal.GetSafeNormal2D(), (query.vThreat - vPosition).GetSafeNormal2D());
+
+						if (threatDot < query.fMinThreatDot)
+							return true;
+
+						score += 1.0f - threatDot;
 					}
 
-					//sort vertices by height < 
-					SortArrayByLowestHeight(verts);
+					if (outNodes.Num() == query.maxResults && score >= scores.Last())
+						return true;
+
+					//keep the results sorted, there's only a handful of them
+					int32 insertAt = outNodes.Num();
+					while (insertAt > 0 && scores[insertAt - 1] > score)
+						insertAt--;
 
-					//delete vertices on the same X and Y axis as we only need one (lowest of each)
-					TArray<FVector> deleteVerts;
-					for (int vertIndex = 0; vertIndex < verts.Num() - 1; ++vertIndex)
+					scores.Insert(score, insertAt);
+					outNodes.Insert(nodeRef, insertAt);
+
+					if (outNodes.Num() > query.maxResults)
 					{
-						for (int vertIndex2 = vertIndex + 1; vertIndex2 < verts.Num(); ++vertIndex2)
-						{
-							int X1 = (int)verts[vertIndex].X;
-							int X2 = (int)verts[vertIndex2].X;
-							int Y1 = (int)verts[vertIndex].Y;
-							int Y2 = (int)verts[vertIndex2].Y;
-
-							if (X1 == X2 && Y1 == Y2)
-								deleteVerts.Add(verts[vertIndex2]);
-						}
+						scores.Pop(false);
+						outNodes.Pop(false);
 					}
 
-					//store only filtered/valid vertices
-					allVerts.Empty();
+					return true;
+				};
+
+				for (int32 slot = closestSlot; slot <= entry.lastSlot && AddSlot(slot); ++slot);
+				for (int32 slot = closestSlot - 1; slot >= entry.firstSlot && AddSlot(slot); --slot);
+			}
+		}
+	}
+
+	//nodes in front of the one that was claimed were taken by another query in the meantime
+	if (query.claimantID != 0 && query.fClaimDuration > 0.0f)
+	{
+		int32 claimedNode = 0;
+		while (claimedNode < outNodes.Num() && !claims->Claim(outNodes[claimedNode], query.claimantID, query.fClaimDuration))
+			claimedNode++;
 
-					for (FVector vert : verts)
-						if (!(deleteVerts.Contains(vert)))
-							allVerts.Add(vert);
+		outNodes.RemoveAt(0, claimedNode, false);
+	}
+}
 
-					deleteVerts.Empty();
-					verts.Empty();
+bool CoverGen::ClaimCover(const CoverNodeRef& nodeRef, uint32 claimantID, float durationSeconds)
+{
+	return claimantID != 0 && nodeRef.IsValid() && _claims->Claim(nodeRef, claimantID, durationSeconds);
+}
 
-					//create edge links using our filtered vertices 
-					TArray<Edge2*> edgeLinks;
-					CreateEdgeLinks(scaledTris, allVerts, edgeLinks);
+void CoverGen::ReleaseCover(const CoverNodeRef& nodeRef, uint32 claimantID)
+{
+	if (claimantID != 0 && nodeRef.IsValid())
+		_claims->Release(nodeRef, claimantID);
+}
 
-					//ray trace using edge links
-					for (auto eLink : edgeLinks)
-					{
+bool CoverGen::IsCoverClaimed(const CoverNodeRef& nodeRef, uint32 ignoredClaimantID) const
+{
+	return nodeRef.IsValid() && _claims->IsClaimed(nodeRef, ignoredClaimantID);
+}
 
-						float arrowLen = FVector::Distance(eLink->vP1, eLink->vP2) / 2.0f;
-						FVector middlePoint = eLink->vP1 + eLink->vDirection * arrowLen;
-						
-						eLink->vNormal = -(eLink->vNormal); //reverse normal
-						//if object's scale is negative reverse the normal on equivalent axis
-						if (actor->GetActorScale().X < 0.0f)  eLink->vNormal = -eLink->vNormal;
-						if (actor->GetActorScale().Y < 0.0f)  eLink->vNormal = -eLink->vNormal;
-						if (actor->GetActorScale().Z < 0.0f)  eLink->vNormal = -eLink->vNormal;
-
-						DrawDebugDirectionalArrow(_pWorld, eLink->vP1, middlePoint, 2.0f, FColor::Red, true);
-						DrawDebugDirectionalArrow(_pWorld, middlePoint, middlePoint + eLink->vNormal * 5.0f, 5.0f, FColor::Yellow, true);
-					
-						//Add a small offset to avoid clipping
-						eLink->vP1 += eLink->vDirection * 2.0f;
-						eLink->vP2 -= eLink->vDirection * 2.0f;
-
-						if (FVector::Distance(eLink->vP1, eLink->vP2) > spacing * 2.0f)
-						{
-							int maxRayCount = int(FVector::Distance(eLink->vP1, eLink->vP2) / spacing);
-							FVector vNormal; // vector to store our normal
-
-							for (int offset = 0; offset <= maxRayCount; ++offset)
-							{
-								int currentMissCount = 0;
-								CoverNode* currentCoverNode = nullptr;
-								float currentSpacing = (float)(offset * spacing);
-								float fBottomPoint = fBottomOfTheBoundingBox;
-
-								for (float heightOffset = minCover; fBottomPoint + heightOffset <= fTopOfTheBoundingBox; heightOffset += spacing)
-								{
-									float currentHeight = fBottomPoint + heightOffset;
-									FVector pos = FVector(eLink->vP1.X + eLink->vDirection.X * currentSpacing, eLink->vP1.Y + eLink->vDirection.Y * currentSpacing, currentHeight);
-									pos += eLink->vNormal * LargeOffset;
-
-									if (isVecHeightInBounds(fBottomPoint, pos, minCover, maxCover) && currentMissCount <= missAcceptance)
-									{
-										float maxRayDistance = currentCoverNode ? FVector::Distance(currentCoverNode->GetPosition(), pos) + spacing : maxDistance;
-
-										//maxRayDistance
-										FVector hitRes = RayHitTest(pos, -eLink->vNormal, maxRayDistance, actor, vNormal);
-
-										if (hitRes != FVector::ZeroVector)
-										{
-											//only create the first cover node
-											if (!currentCoverNode)
-												currentCoverNode = ptrCurrentCoverObject->AddNewCoverPoint(hitRes, vNormal);
-
-											else
-												currentCoverNode->_fHeight = hitRes.Z;
-
-											currentMissCount = 0;
-										}
-
-										else
-										{
-											currentMissCount++;
-										}
-									}
-									else break;
-								}
-							}
-						}
-
-						//if distance between two points is < spacing * 2.0f, start ray trace between two points and move up (don't move to the sides)
-						else
-						{
-							int currentMissCount = 0;
-							CoverNode* currentCoverNode = nullptr;
-							float fBottomPoint = fBottomOfTheBoundingBox;
-							FVector vNormal; // vector to store our normal
-
-							for (float heightOffset = minCover; fBottomPoint + heightOffset <= fTopOfTheBoundingBox; heightOffset += spacing)
-							{
-								float currentHeight = fBottomPoint + heightOffset;
-								FVector pos = FVector(middlePoint.X, middlePoint.Y, currentHeight);
-								pos += eLink->vNormal * LargeOffset;
-
-								if (isVecHeightInBounds(fBottomPoint, pos, minCover, maxCover) && currentMissCount <= missAcceptance)
-								{
-									float maxRayDistance = currentCoverNode ? FVector::Distance(currentCoverNode->GetPosition(), pos) + spacing : maxDistance;
-									
-									FVector hitRes = RayHitTest(pos, -eLink->vNormal, maxRayDistance, actor, vNormal);
-
-									if (hitRes != FVector::ZeroVector)
-									{
-										//only create the first cover node
-										if (!currentCoverNode)
-											currentCoverNode = ptrCurrentCoverObject->AddNewCoverPoint(hitRes, vNormal);
-
-										else
-											currentCoverNode->_fHeight = hitRes.Z;
-
-										currentMissCount = 0;
-									}
-
-									else
-									{
-										currentMissCount++;
-									}
-								}
-								else break;
-							}
-						}
-					}
+void CoverGen::CompactCoverClaims()
+{
+	//running query batches could still claim nodes in the old table
+	if (_runningQueryBatch || _claims->GetNumKeys() < _claims->GetCapacity() / 2)
+		return;
+
+	const int32 failedClaims = _claims->GetNumFailedClaims();
+
+	if (failedClaims > 0)
+	{
+		INC_DWORD_STAT_BY(STAT_CoverGen_FailedClaims, failedClaims);
+		UE_LOG(LogTemp, Warning, TEXT("%d cover claims failed because the claim table was full (%d slots), it's resized to fit the live claims"), failedClaims, _claims->GetCapacity());
+	}
+
+	//live claims take at most a quarter of the new table, so it doesn't have to be compacted again right away (back to maxCoverClaims once they expire)
+	const int32 liveClaims = _claims->GetNumLiveClaims();
+	int32 capacity = FMath::RoundUpToPowerOfTwo(FMath::Max(_settings.maxCoverClaims, 16));
+
+	while (liveClaims >= capacity / 4)
+		capacity *= 2;
+
+	CoverClaimTablePtr compactedClaims = MakeShared<CoverClaimTable, ESPMode::ThreadSafe>(capacity, FPlatformTime::Seconds());
+	_claims->CopyLiveClaims(*compactedClaims);
+	_claims = compactedClaims;
+}
+
+CoverGen::CoverClaimTable::CoverClaimTable(int32 capacity, double timeOrigin) : _timeOrigin(timeOrigin)
+{
+	const int32 tableSize = FMath::RoundUpToPowerOfTwo(FMath::Max(capacity, 16));
+	_keys.Init(0, tableSize);
+	_claims.Init(0, tableSize);
+}
+
+int32 CoverGen::CoverClaimTable::FindSlot(uint64 key, bool bAdd)
+{
+	const int32 mask = _keys.Num() - 1;
+	int32 slot = GetTypeHash(key) & mask;
+
+	//linear probing, slots are only ever taken so a key can't move once it's in the table
+	for (int32 probe = 0; probe < _keys.Num(); ++probe, slot = (slot + 1) & mask)
+	{
+		const uint64 slotKey = (uint64)FPlatformAtomics::AtomicRead(&_keys[slot]);
+
+		if (slotKey == key)
+			return slot;
+
+		if (slotKey != 0)
+			continue;
+
+		if (!bAdd)
+			return INDEX_NONE;
+
+		const uint64 previousKey = (uint64)FPlatformAtomics::InterlockedCompareExchange(&_keys[slot], (int64)key, 0);
+
+		if (previousKey == 0)
+		{
+			FPlatformAtomics::InterlockedIncrement(&_numKeys);
+			return slot;
+		}
+
+		//another thread took the slot first, it could have added the same key
+		if (previousKey == key)
+			return slot;
+	}
+
+	return INDEX_NONE;
+}
+
+int32 CoverGen::CoverClaimTable::FindSlot(uint64 key) const
+{
+	return const_cast<CoverClaimTable*>(this)->FindSlot(key, false);
+}
+
+bool CoverGen::CoverClaimTable::Claim(const CoverNodeRef& nodeRef, uint32 claimantID, float durationSeconds)
+{
+	const int32 slot = FindSlot(MakeKey(nodeRef), true);
+
+	//counted and reported by CompactCoverClaims on the game thread, the table grows on the next compaction
+	if (slot == INDEX_NONE)
+	{
+		FPlatformAtomics::InterlockedIncrement(&_numFailedClaims);
+		return false;
+	}
+
+	const uint32 now = GetTimeMs();
+	const int64 newClaim = (int64)MakeClaim(claimantID, now + (uint32)FMath::Max(0.0f, durationSeconds * 1000.0f));
 
-					//clear edge links as we don't need them anymore
-					for (auto edgeLink : edgeLinks)
-						delete edgeLink;
+	while (true)
+	{
+		const int64 currentClaim = FPlatformAtomics::AtomicRead(&_claims[slot]);
+		const uint32 currentClaimant = (uint32)((uint64)currentClaim >> 32);
+		const uint32 currentExpiry = (uint32)currentClaim;
+
+		if (currentClaim != 0 && currentClaimant != claimantID && currentExpiry > now)
+			return false;
+
+		if (FPlatformAtomics::InterlockedCompareExchange(&_claims[slot], newClaim, currentClaim) == currentClaim)
+			return true;
+	}
+}
+
+void CoverGen::CoverClaimTable::Release(const CoverNodeRef& nodeRef, uint32 claimantID)
+{
+	const int32 slot = FindSlot(MakeKey(nodeRef));
+
+	if (slot == INDEX_NONE)
+		return;
+
+	//if the claim changed hands in the meantime it isn't ours to release
+	const int64 currentClaim = FPlatformAtomics::AtomicRead(&_claims[slot]);
+
+	if ((uint32)((uint64)currentClaim >> 32) == claimantID)
+		FPlatformAtomics::InterlockedCompareExchange(&_claims[slot], 0, currentClaim);
+}
+
+bool CoverGen::CoverClaimTable::IsClaimed(const CoverNodeRef& nodeRef, uint32 ignoredClaimantID) const
+{
+	const int32 slot = FindSlot(MakeKey(nodeRef));
+
+	if (slot == INDEX_NONE)
+		return false;
+
+	const int64 currentClaim = FPlatformAtomics::AtomicRead(&_claims[slot]);
+	const uint32 currentClaimant = (uint32)((uint64)currentClaim >> 32);
+
+	return currentClaim != 0 && currentClaimant != ignoredClaimantID && (uint32)currentClaim > GetTimeMs();
+}
+
+int32 CoverGen::CoverClaimTable::GetNumLiveClaims() const
+{
+	const uint32 now = GetTimeMs();
+	int32 liveClaims = 0;
+
+	for (int32 slot = 0; slot < _keys.Num(); ++slot)
+	{
+		const int64 claim = FPlatformAtomics::AtomicRead(&_claims[slot]);
+
+		if (claim != 0 && (uint32)claim > now)
+			liveClaims++;
+	}
+
+	return liveClaims;
+}
+
+void CoverGen::CoverClaimTable::CopyLiveClaims(CoverClaimTable& target) const
+{
+	const uint32 now = GetTimeMs();
+
+	for (int32 slot = 0; slot < _keys.Num(); ++slot)
+	{
+		const uint64 key = (uint64)FPlatformAtomics::AtomicRead(&_keys[slot]);
+		const int64 claim = FPlatformAtomics::AtomicRead(&_claims[slot]);
+		const uint32 expiry = (uint32)claim;
+
+		if (key == 0 || claim == 0 || expiry <= now)
+			continue;
+
+		//both tables keep their own time, the claim keeps whatever time it had left
+		CoverNodeRef nodeRef;
+		nodeRef.objectID = (int32)(key >> 32) - 1;
+		nodeRef.node     = (int32)(uint32)key;
+		target.Claim(nodeRef, (uint32)((uint64)claim >> 32), (expiry - now) / 1000.0f);
+	}
+}
+
+bool CoverGen::GetCoverNode(const CoverNodeRef& nodeRef, FVector& outPosition, FVector& outNormal, float& outHeight)
+{
+	if (_bQueryIndexDirty)
+		RebuildQueryIndex();
+
+	const CoverObject* coverObject = _queryIndex->objectsByID.FindRef(nodeRef.objectID);
+
+	return coverObject && coverObject->GetNodes().GetSlot(nodeRef.node, outPosition, outNormal, outHeight);
+}
+
+void CoverGen::RebuildQueryIndex()
+{
+	//a running query batch can still be reading the old index
+	TSharedPtr<CoverQueryIndex, ESPMode::ThreadSafe> index = MakeShared<CoverQueryIndex, ESPMode::ThreadSafe>();
+	index->fCellSize = FMath::Max(_settings.queryCellSize, 1.0f);
+	_bQueryIndexDirty = false;
+
+	//objects that are still being generated don't have their final nodes yet
+	TSet<CoverObject*> unfinishedObjects;
+	for (CoverWorkItem* work : _pendingWork)
+		unfinishedObjects.Add(work->coverObject);
+
+	//(cell, entry) of every cell an entry's edge touches
+	TArray<TPair<FIntPoint, int32>> entryCells;
+
+	for (const TArray<CoverObject*>* coverObjects : { &allCoverObjects->StaticCoverObjects, &allCoverObjects->DynamicCoverObjects })
+	{
+		for (CoverObject* coverObject : *coverObjects)
+		{
+			if (unfinishedObjects.Contains(coverObject))
+				continue;
+
+			index->objectsByID.Add(coverObject->_ID, coverObject);
+			const CoverNodeStore& nodes = coverObject->GetNodes();
+
+			for (int32 segmentIndex = 0; segmentIndex < nodes.NumSegments(); ++segmentIndex)
+			{
+				const CoverCore::CoverSegment& segment = nodes.GetSegment(segmentIndex);
+				const float slotStep = segment.GetSlotStep();
+				const FVector vNormal(segment.vNormal.X, segment.vNormal.Y, segment.vNormal.Z);
+				const CoverNodeHandle lastNode = segment.firstNode + segment.nodeCount - 1;
+				float startDistance = 0.0f;
+
+				//a segment of a single node is an edge of zero length
+				for (CoverNodeHandle node = segment.firstNode; node == segment.firstNode || node < lastNode; ++node)
+				{
+					const CoverNodeHandle endNode = FMath::Min(node + 1, lastNode);
+
+					CoverIndexEntry entry;
+					entry.vStart         = nodes.GetPosition(node);
+					entry.vEnd           = nodes.GetPosition(endNode);
+					entry.vNormal        = vNormal;
+					entry.fStartHeight   = nodes.GetHeight(node);
+					entry.fEndHeight     = nodes.GetHeight(endNode);
+					entry.fStartDistance = startDistance;
+					entry.fEndDistance   = startDistance + FVector::Dist(entry.vStart, entry.vEnd);
+					entry.fSlotStep      = slotStep;
+					entry.objectID       = coverObject->_ID;
+					entry.segmentFirstSlot = segment.firstSlot;
+					startDistance = entry.fEndDistance;
+
+					//slots at [start, end) of the edge, the last edge also takes the ones its end rounds to, a single slot is on the first edge
+					const int32 firstSlot = node == segment.firstNode ? 0 : slotStep > 0.0f ? FMath::CeilToInt(entry.fStartDistance / slotStep - KINDA_SMALL_NUMBER) : segment.slotCount;
+					const int32 lastSlot = endNode == lastNode ? segment.slotCount - 1 : slotStep > 0.0f ? FMath::CeilToInt(entry.fEndDistance / slotStep - KINDA_SMALL_NUMBER) - 1 : 0;
+					entry.firstSlot = segment.firstSlot + FMath::Max(firstSlot, 0);
+					entry.lastSlot  = segment.firstSlot + FMath::Min(lastSlot, segment.slotCount - 1);
+
+					if (entry.firstSlot > entry.lastSlot)
+						continue;
+
+					entry.minCell = index->GetCell(entry.vStart.ComponentMin(entry.vEnd));
+					const FIntPoint maxCell = index->GetCell(entry.vStart.ComponentMax(entry.vEnd));
+					const int32 entryIndex = index->entries.Add(entry);
+
+					for (int32 x = entry.minCell.X; x <= maxCell.X; ++x)
+						for (int32 y = entry.minCell.Y; y <= maxCell.Y; ++y)
+							entryCells.Add(TPair<FIntPoint, int32>(FIntPoint(x, y), entryIndex));
+				}
+			}
+		}
+	}
+
+	//group entries of the same cell together
+	Algo::Sort(entryCells, [](const TPair<FIntPoint, int32>& A, const TPair<FIntPoint, int32>& B)
+	{
+		if (A.Key.X != B.Key.X) return A.Key.X < B.Key.X;
+		if (A.Key.Y != B.Key.Y) return A.Key.Y < B.Key.Y;
+		return A.Value < B.Value;
+	});
+
+	index->cellEntries.Reserve(entryCells.Num());
+
+	for (const TPair<FIntPoint, int32>& entryCell : entryCells)
+	{
+		FIntPoint& cell = index->cells.FindOrAdd(entryCell.Key, FIntPoint(index->cellEntries.Num(), 0));
+		cell.Y++;
+		index->cellEntries.Add(entryCell.Value);
+	}
+
+	_queryIndex = index;
+}
+
+bool CoverGen::PrepareNextActor()
+{
+	if (_nextActorToPrepare >= _actorsToPrepare.Num())
+		return false;
+
+	AActor* actor = _actorsToPrepare[_nextActorToPrepare++].Get();
+
+	//actor's level was streamed out while it was waiting
+	if (actor && !_levels.Contains(actor->GetLevel()))
+		actor = nullptr;
+
+	if (actor && _settings.bIncrementalUpdates && !actor->ActorHasTag("NoCover"))
+		TrackActor(actor);
+
+	CoverWorkItem* work = actor ? PrepareCoverWork(actor, _spacing) : nullptr;
+
+	//actor was destroyed or doesn't give any cover
+	if (!work)
+	{
+		_actorsFinished++;
+		return true;
+	}
+
+	QueueCoverWork(work);
+	return true;
+}
+
+void CoverGen::QueueCoverWork(CoverWorkItem* work)
+{
+	// rays are submitted from Tick and resolved once their results come back
+	if (_settings.bBatchedTraces)
+	{
+		const int32 columnCount = (int32)work->columns.size();
+		work->columnRayStarts.SetNum(columnCount);
+		work->columnHits.SetNum(columnCount);
+		work->columnReady.Init(false, columnCount);
+	}
+
+	_pendingWork.Add(work);
+}
+
+void CoverGen::RunScheduledWork(double budgetSeconds)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(CoverGen_RunScheduledWork);
+	const double endTime = FPlatformTime::Seconds() + budgetSeconds;
+	const bool bUnlimited = budgetSeconds <= 0.0;
+
+	//batched traces are resolved in Tick, we only have to create the work items
+	if (_settings.bBatchedTraces)
+	{
+		while (bUnlimited || FPlatformTime::Seconds() < endTime)
+			if (!PrepareNextActor())
+				break;
+	}
+
+	//no time limit, prepare everything and run it in one go (on worker threads if bParallelGeneration is set)
+	else if (bUnlimited)
+	{
+		while (PrepareNextActor())
+			continue;
+
+		TArray<CoverWorkItem*> preparedWork = MoveTemp(_pendingWork);
+		_pendingWork.Empty();
+		RunCoverWork(preparedWork, true);
+	}
+
+	//finish objects one by one, a single column at a time, so a large object can be spread over several frames
+	else
+	{
+		while (FPlatformTime::Seconds() < endTime)
+		{
+			if (_pendingWork.Num() == 0 && !PrepareNextActor())
+				break;
+
+			if (_pendingWork.Num() == 0)
+				continue;
+
+			CoverWorkItem* work = _pendingWork[0];
+
+			if (work->nextColumnToResolve < (int32)work->columns.size())
+			{
+				COVER_PHASE_SCOPE(work, RaySweeps);
+				TraceColumn(work, work->columns[work->nextColumnToResolve++], _workspace);
+			}
+
+			else
+			{
+				TArray<CoverWorkItem*> finishedWork = { work };
+				_pendingWork.RemoveAt(0);
+				RunCoverWork(finishedWork, false);
+			}
+		}
+	}
+
+	//regenerated actors don't finish the generation again
+	if (IsGenerationFinished() && !_bGenerationReported)
+	{
+		_bGenerationReported = true;
+		UE_LOG(LogTemp, Log, TEXT("Cover generation finished: %d objects in %.2f s"), allCoverObjects->DynamicCoverObjects.Num() + allCoverObjects->StaticCoverObjects.Num(), FPlatformTime::Seconds() - _generationStartTime);
+		UE_LOG(LogTemp, Log, TEXT("Cover generation stats: %d rays (%d hits, %d misses), %d nodes created, %d merged, %d removed, %d segments, %.2f s spent on objects"),
+			_generationStats.raysCast, _generationStats.rayHits, _generationStats.rayMisses, _generationStats.nodesCreated, _generationStats.nodesMerged, _generationStats.nodesRemoved, _generationStats.segments, _generationStats.GetTotalSeconds());
+
+		for (TPair<ULevel*, LevelCover*>& levelPair : _levels)
+		{
+			if (levelPair.Value->bNeedsBake)
+			{
+				SaveBakedCover(levelPair.Key, levelPair.Value->bakedCoverPath);
+				levelPair.Value->bNeedsBake = false;
+			}
+		}
+	}
+}
+
+CoverGen::CoverWorkItem* CoverGen::PrepareCoverWork(AActor* actor, float spacing, CoverObject* replacedObject)
+{
+	if (actor->ActorHasTag("NoCover"))
+		return nullptr;
+
+	const FVector boundingBoxCenter = actor->GetComponentsBoundingBox().GetCenter();
+	const FVector sizeHalfed = actor->GetComponentsBoundingBox().GetSize() / 2.0f;
+
+	//bottom, top and ray lengths of every column (the object has to be tall enough to give cover)
+	SweepParams sweep;
+	if (!actor->GetActorEnableCollision() || !CoverCore::MakeSweepParams(ToCoreVector(boundingBoxCenter), ToCoreVector(sizeHalfed), spacing, sweep))
+		return nullptr;
+
+	CoverObject* ptrCurrentCoverObject = new CoverObject();
+	ptrCurrentCoverObject->SetLocation(actor->GetComponentsBoundingBox().GetCenter());//set location
+	ptrCurrentCoverObject->SetSize(actor->GetComponentsBoundingBox().GetSize());//set size
+	ptrCurrentCoverObject->_Name = actor->GetName();//set name
+	ptrCurrentCoverObject->_ID = _nextObjectID++; //regenerated cover gets a new ID as well, the replaced object takes it over
+	ptrCurrentCoverObject->_vScale = actor->GetActorScale();
+
+	LevelCover* levelCover = _levels.FindRef(actor->GetLevel());
+
+	// regenerated cover stays outside of the lists until its nodes are moved to the replaced object
+	if (!replacedObject)
+	{
+		if (levelCover)
+			levelCover->coverObjects.Add(ptrCurrentCoverObject);
+
+		// is cover static or dynamic?
+		// Dynamic cover
+		if (actor->IsRootComponentMovable())
+			allCoverObjects->DynamicCoverObjects.Add(ptrCurrentCoverObject);
+
+		// Static cover
+		else
+			allCoverObjects->StaticCoverObjects.Add(ptrCurrentCoverObject);
+
+		if (TrackedActor* trackedActor = _trackedActors.Find(actor->GetUniqueID()))
+			trackedActor->coverObject = ptrCurrentCoverObject;
+	}
+
+	CoverWorkItem* work = new CoverWorkItem();
+	work->actor = actor;
+	work->actorUniqueID = actor->GetUniqueID();
+	work->coverObject = ptrCurrentCoverObject;
+	work->levelCover = levelCover;
+	work->replacedObject = replacedObject;
+	work->bFromGeometry = actor->ActorHasTag("CoverFromGeometry");
+	work->bOptimize = !(actor->ActorHasTag("NoCoverOptimization"));
+	work->bOccupancyBoxes = actor->ActorHasTag("TEST2_");
+
+	work->sweep = sweep;
+
+	//Start cover generation:
+	//OPTION 1 -  use object's geometry for cover generation
+	if (work->bFromGeometry)
+	{
+		TArray<FVector> scaledTris;
+		{
+			COVER_PHASE_SCOPE(work, Geometry);
+			scaledTris = ReconstructAndScaleActorTriangles(actor);
+		}
+
+		{
+			COVER_PHASE_SCOPE(work, EdgeLinks);
+			BuildEdgeLinkColumns(actor, work->coverObject->_ID, scaledTris, work->sweep, work->columns, work->edgeLinkBytes);
+		}
+
+		//the actor's triangles are all the rays can hit, no need to go through the physics scene
+		if (_settings.bLocalGeometryTraces && scaledTris.Num() > 0)
+		{
+			BuildGeometryBVH(scaledTris, work->geometry);
+			work->bLocalTraces = true;
+		}
+	}
+
+	// OPTION 2 - use bounding box for cover generation (simple)
+	//shoot at different heights
+	else
+	{
+		CoverCore::BuildBoxColumns(ToCoreVector(boundingBoxCenter), ToCoreVector(sizeHalfed), work->sweep, work->columns);
+
+		//a single axis aligned box fills its whole bounding box, so every face is known without tracing it
+		work->bAnalytic = _settings.bAnalyticBoxCover && HasAxisAlignedBoxCollision(actor);
+	}
+
+	return work;
+}
+
+void CoverGen::RunCoverWork(TArray<CoverWorkItem*>& workItems, bool bTraceColumns)
+{
+	auto processWork = [this, &workItems, bTraceColumns](int32 workIndex)
+	{
+		CoverWorkItem* work = workItems[workIndex];
+		CoverCore::Workspace* workspace = AcquireWorkspace();
+
+		if (bTraceColumns)
+			TraceColumns(work, *workspace);
+
+		FinalizeCoverWork(work, *workspace);
+		ReleaseWorkspace(workspace);
+	};
+
+	//every work item only touches its own CoverObject so they can be processed in any order
+	if (_settings.bParallelGeneration)
+		ParallelFor(workItems.Num(), processWork);
+
+	else
+		for (int32 workIndex = 0; workIndex < workItems.Num(); ++workIndex)
+			processWork(workIndex);
+
+	//spawning actors has to happen on the game thread
+	for (CoverWorkItem* work : workItems)
+	{
+		if (work->replacedObject)
+		{
+			ReplaceCoverNodes(work->replacedObject, work->coverObject);
+			delete work->coverObject;
+			work->coverObject = work->replacedObject;
+		}
+
+		if (work->bOccupancyBoxes)
+		{
+			COVER_PHASE_SCOPE(work, OccupancyBoxes);
+			CreateOccupancyBoxes(work->coverObject);
+		}
+
+		PublishCoverStats(work);
+
+		if (!work->bIncremental)
+			_actorsFinished++;
+
+		delete work;
+	}
+
+	workItems.Empty();
+	WriteStatsCsv();
+	_bQueryIndexDirty = true;
+	_bDebugDrawDirty = true;
+}
+
+CoverCore::Workspace* CoverGen::AcquireWorkspace()
+{
+	FScopeLock lock(&_workspacePoolLock);
+
+	if (_freeWorkspaces.Num() > 0)
+		return _freeWorkspaces.Pop(false);
+
+	CoverCore::Workspace* workspace = new CoverCore::Workspace();
+	_allWorkspaces.Add(workspace);
+	return workspace;
+}
+
+void CoverGen::ReleaseWorkspace(CoverCore::Workspace* workspace)
+{
+	FScopeLock lock(&_workspacePoolLock);
+	_freeWorkspaces.Add(workspace);
+}
+
+void CoverGen::TraceColumns(CoverWorkItem* work, CoverCore::Workspace& workspace)
+{
+	COVER_PHASE_SCOPE(work, RaySweeps);
+
+	//every column creates at most one node
+	work->nodes.Reserve((int32)work->columns.size());
+
+	for (const RayColumn& column : work->columns)
+		TraceColumn(work, column, workspace);
+}
+
+void CoverGen::TraceColumn(CoverWorkItem* work, const RayColumn& column, CoverCore::Workspace& workspace)
+{
+	std::vector<CoverCore::Vector>& rayStarts = workspace.rayStarts;
+	rayStarts.clear();
+	CoverCore::GetObjectColumnRayStarts(column, work->sweep, work->bAnalytic, GetCoreSettings(), rayStarts);
+
+	if (work->bLocalTraces)
+	{
+		std::vector<RayHit>& hits = workspace.hits;
+		hits.clear();
+		TraceColumnLocally(work, column, rayStarts, hits);
+		ResolveColumn(work, column, rayStarts, &hits);
+	}
+
+	else
+		ResolveColumn(work, column, rayStarts);
+}
+
+void CoverGen::FinalizeCoverWork(CoverWorkItem* work, CoverCore::Workspace& workspace)
+{
+	CoverObject* coverObject = work->coverObject;
+	CoverDebugShapes* debugShapes = work->bOptimize ? GetDebugShapes(coverObject->_ID, CDC_Optimization) : nullptr; //nullptr if we are finishing on a worker thread
+	CoverPhaseScopes phaseScopes;
+
+	CoverCore::OptimizeDebug optimizeDebug;
+	const int32 chainCount = CoverCore::FinishObjectNodes(work->nodes, workspace, work->sweep, work->bFromGeometry, work->bOptimize, GetCoreSettings(), workspace.segments, &work->stats, &phaseScopes, debugShapes ? &optimizeDebug : nullptr);
+
+	if (chainCount > 1)
+		UE_LOG(LogTemp, Warning, TEXT("There were holes in the geometry of %s, its cover is split into %d chains."), *(coverObject->GetName()), chainCount);
+
+	if (debugShapes)
+	{
+		//the first chain starts red, chains that start after a hole in the geometry are yellow
+		for (size_t chain = 0; chain < optimizeDebug.chainStarts.size(); ++chain)
+		{
+			const FVector vChainStart = ToFVector(optimizeDebug.chainStarts[chain]);
+			debugShapes->AddPoint(CDC_Optimization, vChainStart + FVector::UpVector * 3.0f, 4.0f, chain == 0 ? FColor::Red : FColor::Yellow);
+
+			if (chain > 0)
+				debugShapes->AddPoint(CDC_Optimization, vChainStart + FVector::UpVector * 100.0f, 4.0f, FColor::Yellow);
+		}
+
+		for (const CoverCore::Vector& vRemovedNode : optimizeDebug.removedNodes)
+			debugShapes->AddPoint(CDC_Optimization, ToFVector(vRemovedNode), 4.0f, FColor::Red);
+	}
+
+	coverObject->_nodes.Assign(work->nodes, workspace.segments, coverObject->vLocation);
+	work->nodes.Clear();
+}
+
+void CoverGen::PublishCoverStats(const CoverWorkItem* work)
+{
+	const CoverGenStats& stats = work->stats;
+	CoverObject* coverObject = work->coverObject;
+
+	INC_DWORD_STAT(STAT_CoverGen_Objects);
+	INC_DWORD_STAT_BY(STAT_CoverGen_RaysCast, stats.raysCast);
+	INC_DWORD_STAT_BY(STAT_CoverGen_RayHits, stats.rayHits);
+	INC_DWORD_STAT_BY(STAT_CoverGen_RayMisses, stats.rayMisses);
+	INC_DWORD_STAT_BY(STAT_CoverGen_NodesCreated, stats.nodesCreated);
+	INC_DWORD_STAT_BY(STAT_CoverGen_NodesMerged, stats.nodesMerged);
+	INC_DWORD_STAT_BY(STAT_CoverGen_NodesRemoved, stats.nodesRemoved);
+	INC_DWORD_STAT_BY(STAT_CoverGen_Segments, stats.segments);
+	_generationStats.Add(stats);
+
+	UE_LOG(LogTemp, Log, TEXT("Cover object %s: %d nodes in %d segments, %llu bytes (%llu bytes of edge links while generating), %d rays, %.2f ms"), *(coverObject->GetName()), coverObject->GetNodes().Num(), coverObject->GetNodes().NumSegments(), (uint64)coverObject->GetAllocatedSize(), (uint64)work->edgeLinkBytes, stats.raysCast, stats.GetTotalSeconds() * 1000.0);
+
+	if (_settings.statsCsvPath.IsEmpty())
+		return;
+
+	_statsCsvRows += FString::Printf(TEXT("%s,%d,%d,%d,%d,%d,%d,%d,%d"), *(coverObject->GetName()), coverObject->GetNodes().Num(), stats.raysCast, stats.rayHits, stats.rayMisses, stats.nodesCreated, stats.nodesMerged, stats.nodesRemoved, stats.segments);
+
+	for (double phaseSeconds : stats.phaseSeconds)
+		_statsCsvRows += FString::Printf(TEXT(",%.3f"), phaseSeconds * 1000.0);
+
+	_statsCsvRows += FString::Printf(TEXT(",%.3f\n"), stats.GetTotalSeconds() * 1000.0);
+}
+
+void CoverGen::WriteStatsCsv()
+{
+	if (_statsCsvRows.IsEmpty())
+		return;
+
+	//rows of every RunCoverWork are appended in a single write
+	if (!FFileHelper::SaveStringToFile(_statsCsvRows, *_settings.statsCsvPath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append))
+		UE_LOG(LogTemp, Warning, TEXT("Couldn't write cover stats to %s"), *_settings.statsCsvPath);
+
+	_statsCsvRows.Empty();
+}
+
+void CoverGen::BuildEdgeLinkColumns(AActor* actor, int32 objectID, const TArray<FVector>& scaledTris, const SweepParams& sweep, std::vector<RayColumn>& outColumns, SIZE_T& outEdgeLinkBytes)
+{
+	CoverDebugShapes* debugShapes = GetDebugShapes(objectID, CDC_Geometry);
+
+	//DEBUG DRAW POINT OVER "CoverFromGeometry" OBJECT
+	if (debugShapes)
+	{
+		FVector DebugPointPos = actor->GetComponentsBoundingBox().GetCenter();
+		DebugPointPos.Z += actor->GetComponentsBoundingBox().GetSize().Z / 2.0f + 50.0f;
+		debugShapes->AddPoint(CDC_Geometry, DebugPointPos, 20.0f, FColor::White);
+	}
+
+	//triangles are retrieved by PrepareCoverWork (they are also used for local traces)
+	std::vector<CoverCore::Vector> triangles;
+	triangles.reserve(scaledTris.Num());
+
+	for (const FVector& vertex : scaledTris)
+		triangles.push_back(ToCoreVector(vertex));
+
+	std::vector<CoverCore::EdgeLink> debugLinks;
+	outEdgeLinkBytes = CoverCore::BuildMeshColumns(triangles, ToCoreVector(actor->GetActorScale()), sweep, _workspace, outColumns, debugShapes ? &debugLinks : nullptr);
+
+	for (const CoverCore::EdgeLink& eLink : debugLinks)
+	{
+		const FVector vP1 = ToFVector(eLink.vP1);
+		const FVector vNormal = ToFVector(eLink.vNormal);
+		const FVector middlePoint = vP1 + ToFVector(eLink.vDirection) * (FVector::Distance(vP1, ToFVector(eLink.vP2)) / 2.0f);
+
+		debugShapes->AddArrow(CDC_Geometry, vP1, middlePoint, 2.0f, FColor::Red);
+		debugShapes->AddArrow(CDC_Geometry, middlePoint, middlePoint + vNormal * 5.0f, 5.0f, FColor::Yellow);
+	}
+}
+
+CoverCore::GenerationSettings CoverGen::GetCoreSettings() const
+{
+	CoverCore::GenerationSettings settings;
+	settings.spacing = _spacing;
+	settings.bBisectHeights = _settings.bBisectHeights;
+	settings.bAnalyticOcclusionTraces = _settings.bAnalyticOcclusionTraces;
+	settings.segmentMinNormalDot = _settings.segmentMinNormalDot;
+	settings.slotSpacing = _settings.slotSpacing;
+	return settings;
+}
+
+void CoverGen::ResolveColumn(CoverWorkItem* work, const RayColumn& column, const std::vector<CoverCore::Vector>& rayStarts, const std::vector<RayHit>* tracedHits)
+{
+	ColumnRayQuery rays(this, work, column, tracedHits);
+	CoverCore::GenerationSettings settings = GetCoreSettings();
+
+	//traced rays were all traced, even the ones after the column ended
+	if (tracedHits)
+	{
+		work->stats.raysCast += (int32)rayStarts.size();
+		settings.bBisectHeights = false; //there is nothing left to save
+	}
+
+	CoverCore::ResolveObjectColumn(column, work->sweep, rayStarts, work->bAnalytic, settings, rays, work->nodes);
+}
+
+CoverGen::ColumnRayQuery::ColumnRayQuery(CoverGen* coverGen, CoverWorkItem* work, const RayColumn& column, const std::vector<RayHit>* tracedHits) :
+	_coverGen(coverGen),
+	_work(work),
+	_tracedHits(tracedHits),
+	_debugRays(column.iDebugSide > 0 ? coverGen->GetMissedRayDebugShapes(work->coverObject->_ID, column.iDebugSide) : nullptr)
+{
+}
+
+bool CoverGen::ColumnRayQuery::Raycast(int32 rayIndex, const CoverCore::Vector& vStart, const CoverCore::Vector& vDirection, float maxDistance, RayHit& outHit)
+{
+	const FVector pos = ToFVector(vStart);
+	outHit = RayHit();
+
+	if (_tracedHits)
+	{
+		//traced rays are at full length, a ray limited to maxDistance would have missed anything further away
+		const RayHit& hit = (*_tracedHits)[rayIndex];
+
+		if (hit.bHit && hit.fDistance <= maxDistance)
+			outHit = hit;
+	}
+
+	else
+	{
+		FVector vNormal;
+		const FVector hitRes = _coverGen->RayHitTest(pos, ToFVector(vDirection), maxDistance, _work->actor, vNormal);
+		_work->stats.raysCast++;
+
+		if (hitRes != FVector::ZeroVector)
+		{
+			outHit.bHit = true;
+			outHit.vImpact = ToCoreVector(hitRes);
+			outHit.vNormal = ToCoreVector(vNormal);
+			outHit.fDistance = FVector::Distance(pos, hitRes);
+		}
+	}
+
+	if (outHit.bHit)
+	{
+		_work->stats.rayHits++;
+
+		if (_debugRays)
+			_debugRays->AddPoint(CDC_MissedRays, pos, 3.0f, FColor::Green);
+	}
+
+	else
+	{
+		_work->stats.rayMisses++;
+
+		if (_debugRays)
+		{
+			_debugRays->AddPoint(CDC_MissedRays, pos, 3.0f, FColor::Red);
+			_debugRays->AddLine(CDC_MissedRays, pos, pos + ToFVector(vDirection) * (1.0f + maxDistance), FColor::Red);
+		}
+	}
+
+	return outHit.bHit;
+}
+
+bool CoverGen::HasAxisAlignedBoxCollision(AActor* actor) const
+{
+	TArray<UPrimitiveComponent*> primitiveComponents;
+	actor->GetComponents<UPrimitiveComponent>(primitiveComponents);
+
+	int32 boxCount = 0;
+
+	for (UPrimitiveComponent* primitiveComponent : primitiveComponents)
+	{
+		if (!primitiveComponent->IsCollisionEnabled())
+			continue;
+
+		FRotator rotation = primitiveComponent->GetComponentRotation();
+
+		if (primitiveComponent->IsA<UBoxComponent>())
+			boxCount++;
+
+		else if (UStaticMeshComponent* meshComponent = Cast<UStaticMeshComponent>(primitiveComponent))
+		{
+			UBodySetup* bodySetup = meshComponent->GetBodySetup();
+
+			if (!bodySetup || bodySetup->CollisionTraceFlag == CTF_UseComplexAsSimple)
+				return false;
+
+			const FKAggregateGeom& aggGeom = bodySetup->AggGeom;
+
+			if (aggGeom.BoxElems.Num() != 1 || aggGeom.SphereElems.Num() > 0 || aggGeom.SphylElems.Num() > 0 || aggGeom.ConvexElems.Num() > 0 || aggGeom.TaperedCapsuleElems.Num() > 0)
+				return false;
+
+			rotation = (FQuat(rotation) * FQuat(aggGeom.BoxElems[0].Rotation)).Rotator();
+			boxCount++;
+		}
+
+		//anything else could leave holes in the bounding box
+		else
+			return false;
+
+		//rotated box doesn't fill its bounding box, a yaw of 90 degrees still does
+		const float yawRemainder = FMath::Abs(FMath::Fmod(rotation.Yaw, 90.0f));
+
+		if (!FMath::IsNearlyZero(rotation.Pitch, 0.1f) || !FMath::IsNearlyZero(rotation.Roll, 0.1f) || (yawRemainder > 0.1f && yawRemainder < 89.9f))
+			return false;
+	}
+
+	//more boxes can make any shape (L, T...)
+	return boxCount == 1;
+}
+
+FString CoverGen::GetBakedCoverPath(ULevel* level)
+{
+	const FString levelName = FPackageName::GetShortName(UWorld::RemovePIEPrefix(level->GetOutermost()->GetName()));
+	return FPaths::ProjectContentDir() / TEXT("CoverData") / levelName + TEXT(".cover");
+}
+
+//segments have to stay inside their object's nodes and number their slots one after another, queries index nodes and slots through them
+static bool AreBakedSegmentsValid(const CoverCore::CoverSegment* segments, int32 segmentCount, int32 nodeCount)
+{
+	int32 nextSlot = 0;
+
+	for (int32 segmentIndex = 0; segmentIndex < segmentCount; ++segmentIndex)
+	{
+		const CoverCore::CoverSegment& segment = segments[segmentIndex];
+
+		if (segment.firstNode < 0 || segment.nodeCount < 1 || segment.firstNode + segment.nodeCount > nodeCount || segment.firstSlot != nextSlot || segment.slotCount < 1 || !(segment.fLength >= 0.0f))
+			return false;
+
+		nextSlot += segment.slotCount;
+	}
+
+	return true;
+}
+
+bool CoverGen::SaveBakedCover(ULevel* level, const FString& filePath) const
+{
+	const LevelCover* levelCover = _levels.FindRef(level);
+
+	if (!levelCover || !IsGenerationFinished())
+		return false;
+
+	const TArray<CoverObject*>& coverObjects = levelCover->coverObjects;
+
+	TArray<BakedCoverObject> objectTable;
+	TArray<CoverCore::PackedNode> packedNodes;
+	TArray<CoverCore::CoverSegment> segments;
+	TArray<uint8> nameData;
+	int32 nodeCount = 0;
+
+	for (int32 objectIndex = 0; objectIndex < coverObjects.Num(); ++objectIndex)
+	{
+		CoverObject* coverObject = coverObjects[objectIndex];
+		FTCHARToUTF8 name(*coverObject->_Name);
+
+		BakedCoverObject bakedObject;
+		bakedObject.id         = objectIndex; //IDs are given out again when the file is loaded
+		bakedObject.firstNode  = nodeCount;
+		bakedObject.nodeCount  = coverObject->_nodes.Num();
+		bakedObject.firstSegment = segments.Num();
+		bakedObject.segmentCount = coverObject->_nodes.NumSegments();
+		bakedObject.nameOffset = nameData.Num();
+		bakedObject.nameLength = name.Length();
+		bakedObject.bDynamic   = allCoverObjects->DynamicCoverObjects.Contains(coverObject) ? 1 : 0;
+		bakedObject.location   = coverObject->vLocation;
+		bakedObject.size       = coverObject->GetSize();
+		bakedObject.scale      = coverObject->_vScale;
+		bakedObject.nodeOrigin = ToFVector(coverObject->_nodes._frame.vOrigin);
+		bakedObject.nodeStep   = coverObject->_nodes._frame.step;
+		objectTable.Add(bakedObject);
+
+		nameData.Append((const uint8*)name.Get(), name.Length());
+
+		//occupancy boxes are created at runtime, they aren't baked
+		const CoverNodeStore& nodes = coverObject->_nodes;
+		packedNodes.Append(nodes._nodeView.GetData(), nodes._nodeView.Num());
+		segments.Append(nodes._segmentView.GetData(), nodes._segmentView.Num());
+		nodeCount += nodes.Num();
+	}
+
+	BakedCoverHeader header;
+	header.magic       = BakedCoverMagic;
+	header.version     = BakedCoverVersion;
+	header.nodeSize    = BakedCoverNodeSize;
+	header.segmentSize = BakedCoverSegmentSize;
+	header.objectCount = objectTable.Num();
+	header.nodeCount   = nodeCount;
+	header.segmentCount = segments.Num();
+	header.nameBytes   = nameData.Num();
+
+	TArray<uint8> fileData;
+	fileData.Append((const uint8*)&header, sizeof(BakedCoverHeader));
+	fileData.Append((const uint8*)objectTable.GetData(), objectTable.Num() * sizeof(BakedCoverObject));
+	fileData.Append((const uint8*)segments.GetData(), segments.Num() * sizeof(CoverCore::CoverSegment)); //before the nodes, so they stay aligned
+	fileData.Append((const uint8*)packedNodes.GetData(), packedNodes.Num() * sizeof(CoverCore::PackedNode));
+	fileData.Append(nameData);
+
+	IFileManager::Get().MakeDirectory(*FPaths::GetPath(filePath), true);
+
+	if (!FFileHelper::SaveArrayToFile(fileData, *filePath))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Couldn't write baked cover to %s"), *filePath);
+		return false;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Baked %d cover objects (%d nodes) to %s"), objectTable.Num(), nodeCount, *filePath);
+	return true;
+}
+
+bool CoverGen::LoadBakedCover(LevelCover* levelCover)
+{
+	const FString& filePath = levelCover->bakedCoverPath;
+	IPlatformFile& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+
+	if (!platformFile.FileExists(*filePath))
+		return false;
+
+	const uint8* data = nullptr;
+	int64 dataSize = 0;
+
+	//nodes and segments are used in place, the file stays mapped until the level's cover is released
+	levelCover->bakedFileHandle = platformFile.OpenMapped(*filePath);
+
+	if (levelCover->bakedFileHandle)
+		levelCover->bakedFileRegion = levelCover->bakedFileHandle->MapRegion(0, levelCover->bakedFileHandle->GetFileSize());
+
+	if (levelCover->bakedFileRegion)
+	{
+		data = levelCover->bakedFileRegion->GetMappedPtr();
+		dataSize = levelCover->bakedFileRegion->GetMappedSize();
+	}
+
+	//not every platform can map files, read it into memory instead
+	else if (FFileHelper::LoadFileToArray(levelCover->bakedFileData, *filePath))
+	{
+		data = levelCover->bakedFileData.GetData();
+		dataSize = levelCover->bakedFileData.Num();
+	}
+
+	if (data && LoadBakedCoverData(levelCover, data, dataSize))
+		return true;
+
+	ReleaseBakedCover(levelCover);
+	return false;
+}
+
+void CoverGen::ReleaseBakedCover(LevelCover* levelCover)
+{
+	delete levelCover->bakedFileRegion;
+	levelCover->bakedFileRegion = nullptr;
+
+	delete levelCover->bakedFileHandle;
+	levelCover->bakedFileHandle = nullptr;
+
+	levelCover->bakedFileData.Empty();
+}
+
+bool CoverGen::LoadBakedCoverData(LevelCover* levelCover, const uint8* data, int64 dataSize)
+{
+	const FString& filePath = levelCover->bakedCoverPath;
+	const BakedCoverHeader* header = (const BakedCoverHeader*)data;
+
+	if (dataSize < (int64)sizeof(BakedCoverHeader) || header->magic != BakedCoverMagic || header->version != BakedCoverVersion || header->nodeSize != BakedCoverNodeSize || header->segmentSize != BakedCoverSegmentSize)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Baked cover %s is missing or out of date, cover will be generated"), *filePath);
+		return false;
+	}
+
+	const int64 objectTableSize = (int64)header->objectCount * sizeof(BakedCoverObject);
+	const int64 nodeDataSize = (int64)header->nodeCount * BakedCoverNodeSize + (int64)header->segmentCount * BakedCoverSegmentSize;
+
+	if (header->objectCount < 0 || header->nodeCount < 0 || header->segmentCount < 0 || header->nameBytes < 0 || (int64)sizeof(BakedCoverHeader) + objectTableSize + nodeDataSize + header->nameBytes > dataSize)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Baked cover %s is corrupted, cover will be generated"), *filePath);
+		return false;
+	}
+
+	const BakedCoverObject* objectTable = (const BakedCoverObject*)(data + sizeof(BakedCoverHeader));
+	const CoverCore::CoverSegment* segments = (const CoverCore::CoverSegment*)(objectTable + header->objectCount);
+	const CoverCore::PackedNode* packedNodes = (const CoverCore::PackedNode*)(segments + header->segmentCount);
+	const ANSICHAR* nameData = (const ANSICHAR*)(packedNodes + header->nodeCount);
+
+	//baked IDs are only unique within their level
+	const int32 firstObjectID = _nextObjectID;
+
+	for (int32 objectIndex = 0; objectIndex < header->objectCount; ++objectIndex)
+	{
+		const BakedCoverObject& bakedObject = objectTable[objectIndex];
+
+		if (bakedObject.firstNode < 0 || bakedObject.nodeCount < 0 || bakedObject.firstNode + bakedObject.nodeCount > header->nodeCount ||
+			bakedObject.nameOffset < 0 || bakedObject.nameLength < 0 || bakedObject.nameOffset + bakedObject.nameLength > header->nameBytes ||
+			bakedObject.firstSegment < 0 || bakedObject.segmentCount < 0 || bakedObject.firstSegment + bakedObject.segmentCount > header->segmentCount ||
+			!(bakedObject.nodeStep > 0.0f) || !FMath::IsFinite(bakedObject.nodeStep) || !AreBakedSegmentsValid(segments + bakedObject.firstSegment, bakedObject.segmentCount, bakedObject.nodeCount))
+		{
+			UE_LOG(LogTemp, Error, TEXT("Baked cover object %d in %s is corrupted and was skipped"), objectIndex, *filePath);
+			continue;
+		}
+
+		FUTF8ToTCHAR name(nameData + bakedObject.nameOffset, bakedObject.nameLength);
+
+		CoverObject* coverObject = new CoverObject();
+		coverObject->_ID = firstObjectID + bakedObject.id;
+		_nextObjectID = FMath::Max(_nextObjectID, coverObject->_ID + 1);
+		coverObject->_Name = FString(name.Length(), name.Get());
+		coverObject->SetLocation(bakedObject.location);
+		coverObject->SetSize(bakedObject.size);
+		coverObject->_vScale = bakedObject.scale;
+
+		CoverCore::PackedNodeFrame frame;
+		frame.vOrigin = ToCoreVector(bakedObject.nodeOrigin);
+		frame.step = bakedObject.nodeStep;
+		coverObject->_nodes.Assign(frame, packedNodes + bakedObject.firstNode, bakedObject.nodeCount, segments + bakedObject.firstSegment, bakedObject.segmentCount);
+
+		if (bakedObject.bDynamic)
+			allCoverObjects->DynamicCoverObjects.Add(coverObject);
+		else
+			allCoverObjects->StaticCoverObjects.Add(coverObject);
+
+		levelCover->coverObjects.Add(coverObject);
+	}
+
+	_bQueryIndexDirty = true;
+	_bDebugDrawDirty = true;
+	return true;
+}
+
+void CoverGen::OnLevelAdded(ULevel* level, UWorld* world)
+{
+	if (world == _pWorld)
+		GenerateCoverPoints(level, _spacing);
+}
+
+void CoverGen::OnLevelRemoved(ULevel* level, UWorld* world)
+{
+	if (world != _pWorld)
+		return;
+
+	//nullptr - all of the world's levels are being removed
+	if (!level)
+	{
+		TArray<ULevel*> levels;
+		_levels.GetKeys(levels);
+
+		for (ULevel* loadedLevel : levels)
+			ReleaseLevelCover(loadedLevel);
+	}
+
+	else
+		ReleaseLevelCover(level);
+}
+
+void CoverGen::ReleaseLevelCover(ULevel* level)
+{
+	LevelCover* levelCover = _levels.FindRef(level);
+
+	if (!levelCover)
+		return;
+
+	//drop the level's work that didn't finish yet, late trace results of its columns are ignored
+	TArray<CoverWorkItem*> remainingWork;
+
+	for (CoverWorkItem* work : _pendingWork)
+	{
+		if (work->levelCover == levelCover)
+		{
+			_inFlightColumns.RemoveAll([work](const PendingColumn& pending) { return pending.work == work; });
+
+			//regenerated nodes were never swapped in, nothing else owns them
+			if (work->replacedObject)
+				delete work->coverObject;
+
+			if (!work->bIncremental)
+				_actorsFinished++;
+
+			delete work;
+		}
+
+		else
+			remainingWork.Add(work);
+	}
+
+	_pendingWork = MoveTemp(remainingWork);
+
+	//level's actors are going away, stop listening to them
+	TArray<uint32> untrackedActorIDs;
+
+	for (const TPair<uint32, TrackedActor>& trackedPair : _trackedActors)
+	{
+		const AActor* actor = trackedPair.Value.actor.Get();
+
+		if (!actor || actor->GetLevel() == level)
+			untrackedActorIDs.Add(trackedPair.Key);
+	}
+
+	for (uint32 actorUniqueID : untrackedActorIDs)
+	{
+		UntrackActor(actorUniqueID);
+		_dirtyActors.Remove(actorUniqueID);
+	}
+
+	for (CoverObject* coverObject : levelCover->coverObjects)
+	{
+		ReleaseOccupancyBoxes(coverObject);
+		_debugShapes.Remove(coverObject->_ID);
+
+		allCoverObjects->DynamicCoverObjects.Remove(coverObject);
+		allCoverObjects->StaticCoverObjects.Remove(coverObject);
+		delete coverObject;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Released cover of %s (%d objects)"), *level->GetOutermost()->GetName(), levelCover->coverObjects.Num());
+
+	_levels.Remove(level);
+	ReleaseBakedCover(levelCover);
+	delete levelCover;
+	_bQueryIndexDirty = true;
+	_bDebugDrawDirty = true;
+}
+
+void CoverGen::Tick(float DeltaTime)
+{
+	//results of the queries issued during the previous frame
+	FinishQueryBatch();
+
+	//regenerated actors go through the same budget and trace batches as the level's actors
+	if (!IsGenerationFinished() || _pendingWork.Num() > 0)
+	{
+		if (_settings.bBatchedTraces)
+		{
+			//results of the rays submitted on the previous frame
+			CollectTraceBatch();
+			ResolveReadyColumns();
+		}
+
+		RunScheduledWork(_settings.frameBudgetMs / 1000.0);
+
+		if (_settings.bBatchedTraces)
+			SubmitTraceBatch();
+
+		//once per whole percent, batched traces can take hundreds of frames
+		if (!IsGenerationFinished())
+		{
+			const int32 progress = FMath::FloorToInt(GetGenerationProgress() * 100.0f);
+
+			if (progress != _loggedProgress)
+			{
+				_loggedProgress = progress;
+				UE_LOG(LogTemp, Log, TEXT("Cover generation: %d/%d actors (%d%%)"), _actorsFinished, _actorsToPrepare.Num(), progress);
+			}
+		}
+	}
+
+	//changes made during generation wait until it's done, the actors could still be waiting in the queue or being regenerated
+	else if (_dirtyActors.Num() > 0)
+		UpdateDirtyActors();
+
+	UpdateOccupancy();
+	UpdateDebugDraw();
+
+	//nothing is querying between the two batches
+	CompactCoverClaims();
+	StartQueryBatch();
+}
+
+void CoverGen::TrackActor(AActor* actor)
+{
+	const uint32 actorUniqueID = actor->GetUniqueID();
+
+	if (_trackedActors.Contains(actorUniqueID))
+		return;
+
+	TrackedActor& trackedActor = _trackedActors.Add(actorUniqueID);
+	trackedActor.actor = actor;
+
+	actor->OnDestroyed.AddUniqueDynamic(_actorListener, &UCoverActorListener::OnActorDestroyed);
+
+	//static actors can't move, we only need to know when they are destroyed
+	if (actor->IsRootComponentMovable())
+		trackedActor.transformUpdatedHandle = actor->GetRootComponent()->TransformUpdated.AddRaw(this, &CoverGen::OnActorTransformUpdated);
+}
+
+void CoverGen::UntrackActor(uint32 actorUniqueID)
+{
+	TrackedActor trackedActor;
+
+	if (!_trackedActors.RemoveAndCopyValue(actorUniqueID, trackedActor))
+		return;
+
+	if (AActor* actor = trackedActor.actor.Get())
+	{
+		actor->OnDestroyed.RemoveDynamic(_actorListener, &UCoverActorListener::OnActorDestroyed);
+
+		if (trackedActor.transformUpdatedHandle.IsValid() && actor->GetRootComponent())
+			actor->GetRootComponent()->TransformUpdated.Remove(trackedActor.transformUpdatedHandle);
+	}
+}
+
+void CoverGen::MarkActorDirty(AActor* actor, bool bDestroyed)
+{
+	DirtyActor& dirtyActor = _dirtyActors.FindOrAdd(actor->GetUniqueID());
+	dirtyActor.actor = actor;
+	dirtyActor.lastChangeTime = FPlatformTime::Seconds();
+	dirtyActor.bDestroyed |= bDestroyed;
+}
+
+void CoverGen::OnActorSpawned(AActor* actor)
+{
+	//pawns move all the time, they aren't cover
+	if (!actor || actor->IsA<APawn>() || actor->ActorHasTag("NoCover"))
+		return;
+
+	TrackActor(actor);
+	MarkActorDirty(actor, false);
+}
+
+void CoverGen::OnActorDestroyed(AActor* actor)
+{
+	MarkActorDirty(actor, true);
+}
+
+void CoverGen::OnActorTransformUpdated(USceneComponent* updatedComponent, EUpdateTransformFlags updateTransformFlags, ETeleportType teleport)
+{
+	if (AActor* actor = updatedComponent->GetOwner())
+		MarkActorDirty(actor, false);
+}
+
+void CoverGen::UpdateDirtyActors()
+{
+	const double currentTime = FPlatformTime::Seconds();
+	bool bCoverChanged = false;
+
+	for (auto dirtyIt = _dirtyActors.CreateIterator(); dirtyIt; ++dirtyIt)
+	{
+		const uint32 actorUniqueID = dirtyIt.Key();
+		const DirtyActor& dirtyActor = dirtyIt.Value();
+		AActor* actor = dirtyActor.actor.Get();
+
+		//wait until the actor stops moving
+		if (actor && !dirtyActor.bDestroyed && currentTime - dirtyActor.lastChangeTime < _settings.dirtySettleTime)
+			continue;
+
+		TrackedActor* trackedActor = _trackedActors.Find(actorUniqueID);
+		CoverObject* coverObject = trackedActor ? trackedActor->coverObject : nullptr;
+
+		if (!actor || dirtyActor.bDestroyed)
+		{
+			if (coverObject)
+				RemoveCoverObject(coverObject);
+
+			UntrackActor(actorUniqueID);
+			bCoverChanged = true;
+		}
+
+		//actor has a cover object already, generate new nodes and swap them in once the scheduler finishes them
+		else if (CoverWorkItem* work = PrepareCoverWork(actor, _spacing, coverObject))
+		{
+			work->bIncremental = true;
+			QueueCoverWork(work);
+		}
+
+		//actor doesn't give cover anymore
+		else if (coverObject)
+		{
+			CoverObject emptyCoverObject;
+			ReplaceCoverNodes(coverObject, &emptyCoverObject);
+			bCoverChanged = true;
+		}
+
+		dirtyIt.RemoveCurrent();
+	}
+
+	//regenerated work marks them itself once it's done
+	if (bCoverChanged)
+	{
+		_bQueryIndexDirty = true;
+		_bDebugDrawDirty = true;
+	}
+}
+
+void CoverGen::ReplaceCoverNodes(CoverObject* target, CoverObject* source)
+{
+	ReleaseOccupancyBoxes(target);
+	_debugShapes.Remove(target->_ID);
+
+	//slots are numbered again, so the target gets a new ID: refs and claims of the old slots stop resolving instead of pointing at new spots
+	const bool bRegenerated = source->_ID >= 0;
+	target->_ID = bRegenerated ? source->_ID : _nextObjectID++;
+
+	//nodes now belong to the target, source is left empty
+	target->_nodes = MoveTemp(source->_nodes);
+	source->_nodes.Empty();
+
+	if (bRegenerated)
+	{
+		target->SetLocation(source->GetLocation());
+		target->SetSize(source->GetSize());
+	}
+}
+
+void CoverGen::RemoveCoverObject(CoverObject* coverObject)
+{
+	ReleaseOccupancyBoxes(coverObject);
+	_debugShapes.Remove(coverObject->_ID);
+
+	allCoverObjects->DynamicCoverObjects.Remove(coverObject);
+	allCoverObjects->StaticCoverObjects.Remove(coverObject);
+
+	for (TPair<ULevel*, LevelCover*>& levelPair : _levels)
+		levelPair.Value->coverObjects.Remove(coverObject);
+
+	delete coverObject;
+	_bQueryIndexDirty = true;
+	_bDebugDrawDirty = true;
+}
+
+void CoverGen::ReleaseOccupancyBoxes(CoverObject* coverObject)
+{
+	for (int32& boxIndex : coverObject->_nodes._occupancyBoxes)
+	{
+		if (boxIndex < 0)
+			continue;
+
+		CoverOccupancyBox& occupancyBox = _occupancyBoxes[boxIndex];
+
+		//pawns leave the box now, its slot can be reused before the next occupancy update
+		for (auto pawnIt = _pawnOccupancy.CreateIterator(); pawnIt; ++pawnIt)
+		{
+			if (pawnIt.Value().box != boxIndex)
+				continue;
+
+			if (APawn* pawn = pawnIt.Value().pawn.Get())
+				OnCoverExited.Broadcast(pawn, pawnIt.Value().nodeRef);
+
+			pawnIt.RemoveCurrent();
+		}
+
+		FIntPoint minCell, maxCell;
+		GetOccupancyBoxCells(occupancyBox, minCell, maxCell);
+
+		for (int32 x = minCell.X; x <= maxCell.X; ++x)
+			for (int32 y = minCell.Y; y <= maxCell.Y; ++y)
+				if (TArray<int32>* cell = _occupancyCells.Find(FIntPoint(x, y)))
+				{
+					cell->RemoveSwap(boxIndex);
+					if (cell->Num() == 0)
+						_occupancyCells.Remove(FIntPoint(x, y));
+				}
+
+		occupancyBox.bActive = false;
+		_freeOccupancyBoxes.Add(boxIndex);
+		_numOccupancyBoxes--;
+		boxIndex = -1;
+	}
+}
+
+void CoverGen::GetOccupancyBoxCells(const CoverOccupancyBox& occupancyBox, FIntPoint& outMinCell, FIntPoint& outMaxCell)
+{
+	//bounding sphere of the box, grown by the margin so a pawn's center is always in one of the cells
+	const float boxBounds = occupancyBox.vExtent.Size() + OccupancyPawnMargin;
+	outMinCell = FIntPoint(FMath::FloorToInt((occupancyBox.vCenter.X - boxBounds) / OccupancyCellSize), FMath::FloorToInt((occupancyBox.vCenter.Y - boxBounds) / OccupancyCellSize));
+	outMaxCell = FIntPoint(FMath::FloorToInt((occupancyBox.vCenter.X + boxBounds) / OccupancyCellSize), FMath::FloorToInt((occupancyBox.vCenter.Y + boxBounds) / OccupancyCellSize));
+}
+
+int32 CoverGen::AddOccupancyBox(const CoverOccupancyBox& occupancyBox)
+{
+	const int32 boxIndex = _freeOccupancyBoxes.Num() > 0 ? _freeOccupancyBoxes.Pop(false) : _occupancyBoxes.AddDefaulted();
+	_occupancyBoxes[boxIndex] = occupancyBox;
+	_occupancyBoxes[boxIndex].bActive = true;
+	_numOccupancyBoxes++;
+
+	FIntPoint minCell, maxCell;
+	GetOccupancyBoxCells(occupancyBox, minCell, maxCell);
+
+	for (int32 x = minCell.X; x <= maxCell.X; ++x)
+		for (int32 y = minCell.Y; y <= maxCell.Y; ++y)
+			_occupancyCells.FindOrAdd(FIntPoint(x, y)).Add(boxIndex);
+
+	return boxIndex;
+}
+
+void CoverGen::UpdateOccupancy()
+{
+	if (_numOccupancyBoxes == 0 && _pawnOccupancy.Num() == 0)
+		return;
+
+	TSet<uint32> seenPawns;
+
+	for (TActorIterator<APawn> pawnIt(_pWorld); pawnIt; ++pawnIt)
+	{
+		APawn* pawn = *pawnIt;
+		const uint32 pawnID = pawn->GetUniqueID();
+		seenPawns.Add(pawnID);
+
+		//same as a box overlapping the pawn's collision cylinder
+		float pawnRadius = 0.0f, pawnHalfHeight = 0.0f;
+		pawn->GetSimpleCollisionCylinder(pawnRadius, pawnHalfHeight);
+		const FVector pawnLocation = pawn->GetActorLocation();
+
+		int32 currentBox = INDEX_NONE;
+		CoverNodeRef currentSlot;
+		const FIntPoint cellKey(FMath::FloorToInt(pawnLocation.X / OccupancyCellSize), FMath::FloorToInt(pawnLocation.Y / OccupancyCellSize));
+
+		if (const TArray<int32>* cell = _occupancyCells.Find(cellKey))
+		{
+			for (int32 boxIndex : *cell)
+			{
+				const CoverOccupancyBox& occupancyBox = _occupancyBoxes[boxIndex];
+				const FVector localLocation = occupancyBox.qRotation.UnrotateVector(pawnLocation - occupancyBox.vCenter);
+
+				if (FMath::Abs(localLocation.X) <= occupancyBox.vExtent.X + pawnRadius &&
+					FMath::Abs(localLocation.Y) <= occupancyBox.vExtent.Y + pawnRadius &&
+					FMath::Abs(localLocation.Z) <= occupancyBox.vExtent.Z + pawnHalfHeight)
+				{
+					currentBox = boxIndex;
+					currentSlot = GetOccupiedSlot(occupancyBox, localLocation);
+					break;
+				}
+			}
+		}
+
+		//moving along a segment to another slot leaves the previous one
+		PawnOccupancy* occupancy = _pawnOccupancy.Find(pawnID);
+		const CoverNodeRef previousSlot = occupancy ? occupancy->nodeRef : CoverNodeRef();
+
+		if (currentSlot.objectID == previousSlot.objectID && currentSlot.node == previousSlot.node)
+		{
+			if (occupancy)
+				occupancy->box = currentBox;
+			continue;
+		}
+
+		if (occupancy)
+			OnCoverExited.Broadcast(pawn, previousSlot);
+
+		if (currentBox != INDEX_NONE)
+		{
+			PawnOccupancy& newOccupancy = _pawnOccupancy.FindOrAdd(pawnID);
+			newOccupancy.pawn = pawn;
+			newOccupancy.box = currentBox;
+			newOccupancy.nodeRef = currentSlot;
+			OnCoverEntered.Broadcast(pawn, currentSlot);
+		}
+
+		else
+			_pawnOccupancy.Remove(pawnID);
+	}
+
+	//pawns that are gone left their cover as well
+	for (auto pawnIt = _pawnOccupancy.CreateIterator(); pawnIt; ++pawnIt)
+	{
+		if (seenPawns.Contains(pawnIt.Key()))
+			continue;
+
+		if (APawn* pawn = pawnIt.Value().pawn.Get())
+			OnCoverExited.Broadcast(pawn, pawnIt.Value().nodeRef);
+
+		pawnIt.RemoveCurrent();
+	}
+}
+
+void CoverGen::BuildGeometryBVH(const TArray<FVector>& scaledTris, GeometryBVH& outBVH)
+{
+	const int32 triangleCount = scaledTris.Num() / 3;
+	TArray<GeometryTriangle> sourceTriangles;
+	TArray<FVector> centers;
+	TArray<int32> order;
+	sourceTriangles.Reserve(triangleCount);
+	centers.Reserve(triangleCount);
+	order.Reserve(triangleCount);
+
+	for (int32 triIndex = 0; triIndex < triangleCount; ++triIndex)
+	{
+		FVector V0 = scaledTris[triIndex * 3 + 0];
+		FVector V1 = scaledTris[triIndex * 3 + 1];
+		FVector V2 = scaledTris[triIndex * 3 + 2];
+
+		GeometryTriangle triangle;
+		triangle.vV0 = V0;
+		triangle.vEdge1 = V1 - V0;
+		triangle.vEdge2 = V2 - V0;
+		triangle.vNormal = CalculateSurfaceNormalOfATriangle(V0, V1, V2).GetSafeNormal();
+
+		sourceTriangles.Add(triangle);
+		centers.Add(CalculateCenterOfATriangle(V0, V1, V2));
+		order.Add(triIndex);
+	}
+
+	outBVH.nodes.Empty(FMath::Max(1, triangleCount * 2 / GeometryLeafSize));
+	outBVH.nodes.AddDefaulted();
+
+	struct BuildTask
+	{
+		int32 node;
+		int32 begin;
+		int32 end;
+	};
+
+	TArray<BuildTask> tasks;
+	tasks.Add({ 0, 0, triangleCount });
+
+	while (tasks.Num() > 0)
+	{
+		const BuildTask task = tasks.Pop(false);
+		FBox bounds(ForceInit);
+		FBox centerBounds(ForceInit);
+
+		for (int32 orderIndex = task.begin; orderIndex < task.end; ++orderIndex)
+		{
+			const GeometryTriangle& triangle = sourceTriangles[order[orderIndex]];
+			bounds += triangle.vV0;
+			bounds += triangle.vV0 + triangle.vEdge1;
+			bounds += triangle.vV0 + triangle.vEdge2;
+			centerBounds += centers[order[orderIndex]];
+		}
+
+		//flat triangles have flat boxes, grow them a bit so the slab test doesn't miss them
+		outBVH.nodes[task.node].bounds = bounds.ExpandBy(KINDA_SMALL_NUMBER);
+
+		const FVector centerExtent = centerBounds.GetSize();
+		const int32 splitAxis = centerExtent.X >= centerExtent.Y && centerExtent.X >= centerExtent.Z ? 0 : (centerExtent.Y >= centerExtent.Z ? 1 : 2);
+
+		if (task.end - task.begin <= GeometryLeafSize || centerExtent[splitAxis] <= KINDA_SMALL_NUMBER)
+		{
+			outBVH.nodes[task.node].iFirst = task.begin;
+			outBVH.nodes[task.node].iCount = task.end - task.begin;
+			continue;
+		}
+
+		//median split along the longest axis
+		Algo::Sort(MakeArrayView(order.GetData() + task.begin, task.end - task.begin), [&centers, splitAxis](int32 A, int32 B) { return centers[A][splitAxis] < centers[B][splitAxis]; });
+
+		const int32 middle = (task.begin + task.end) / 2;
+		const int32 firstChild = outBVH.nodes.AddDefaulted(2);
+		outBVH.nodes[task.node].iFirst = firstChild;
+		outBVH.nodes[task.node].iCount = 0;
+
+		tasks.Add({ firstChild, task.begin, middle });
+		tasks.Add({ firstChild + 1, middle, task.end });
+	}
+
+	//leaves point to consecutive triangles
+	outBVH.triangles.Empty(triangleCount);
+
+	for (int32 triIndex : order)
+		outBVH.triangles.Add(sourceTriangles[triIndex]);
+}
+
+void CoverGen::TraceColumnLocally(const CoverWorkItem* work, const RayColumn& column, const std::vector<CoverCore::Vector>& rayStarts, std::vector<RayHit>& outHits) const
+{
+	const int32 rayCount = (int32)rayStarts.size();
+	outHits.resize(rayCount);
+
+	//rays are traced at full length, same as batched traces, ResolveColumn shortens them once the column has a node
+	for (int32 rayIndex = 0; rayIndex < rayCount; rayIndex += GeometryPacketSize)
+		TraceGeometryPacket(work->geometry, &rayStarts[rayIndex], FMath::Min(GeometryPacketSize, rayCount - rayIndex), ToFVector(column.vDirection), work->sweep.maxDistance, &outHits[rayIndex]);
+}
+
+void CoverGen::TraceGeometryPacket(const GeometryBVH& bvh, const CoverCore::Vector* rayStarts, int32 rayCount, const FVector& direction, float maxDistance, RayHit* outHits) const
+{
+	check(rayCount > 0 && rayCount <= GeometryPacketSize);
+
+	//rays of a column share their direction, only the origins go into the registers (missing rays repeat the last one)
+	float originComponents[3][GeometryPacketSize];
+
+	for (int32 rayIndex = 0; rayIndex < GeometryPacketSize; ++rayIndex)
+		for (int32 axis = 0; axis < 3; ++axis)
+			originComponents[axis][rayIndex] = rayStarts[FMath::Min(rayIndex, rayCount - 1)][axis];
+
+	const VectorRegister origin[3] = { VectorLoad(originComponents[0]), VectorLoad(originComponents[1]), VectorLoad(originComponents[2]) };
+	const VectorRegister zero = VectorZero();
+	const VectorRegister one = VectorOne();
+	const VectorRegister allTrue = VectorCompareEQ(zero, zero);
+	const VectorRegister minDistance = VectorSetFloat1(KINDA_SMALL_NUMBER);
+
+	VectorRegister bestDistance = VectorSetFloat1(maxDistance);
+	VectorRegister bestTriangle = VectorSetFloat1(-1.0f);
+
+	int32 stack[64];
+	int32 stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const GeometryBVHNode& node = bvh.nodes[stack[--stackSize]];
+
+		//slab test of all rays against the node's box
+		VectorRegister nearDistance = zero;
+		VectorRegister farDistance = bestDistance;
+		VectorRegister boxMask = allTrue;
+
+		for (int32 axis = 0; axis < 3; ++axis)
+		{
+			const VectorRegister boxMin = VectorSetFloat1(node.bounds.Min[axis]);
+			const VectorRegister boxMax = VectorSetFloat1(node.bounds.Max[axis]);
+
+			//parallel to the slab, the origin has to be inside of it
+			if (FMath::Abs(direction[axis]) < SMALL_NUMBER)
+			{
+				boxMask = VectorBitwiseAnd(boxMask, VectorBitwiseAnd(VectorCompareGE(origin[axis], boxMin), VectorCompareGE(boxMax, origin[axis])));
+				continue;
+			}
+
+			const VectorRegister inverseDirection = VectorSetFloat1(1.0f / direction[axis]);
+			const VectorRegister slabDistance1 = VectorMultiply(VectorSubtract(boxMin, origin[axis]), inverseDirection);
+			const VectorRegister slabDistance2 = VectorMultiply(VectorSubtract(boxMax, origin[axis]), inverseDirection);
+
+			nearDistance = VectorMax(nearDistance, VectorMin(slabDistance1, slabDistance2));
+			farDistance = VectorMin(farDistance, VectorMax(slabDistance1, slabDistance2));
+		}
+
+		boxMask = VectorBitwiseAnd(boxMask, VectorCompareGE(farDistance, nearDistance));
+
+		if (VectorMaskBits(boxMask) == 0)
+			continue;
+
+		if (node.iCount == 0)
+		{
+			check(stackSize + 2 <= UE_ARRAY_COUNT(stack));
+			stack[stackSize++] = node.iFirst + 1;
+			stack[stackSize++] = node.iFirst;
+			continue;
+		}
+
+		//Moller-Trumbore, one triangle against all rays of the packet
+		for (int32 triIndex = node.iFirst; triIndex < node.iFirst + node.iCount; ++triIndex)
+		{
+			const GeometryTriangle& triangle = bvh.triangles[triIndex];
+			const FVector P = FVector::CrossProduct(direction, triangle.vEdge2);
+			const float determinant = FVector::DotProduct(triangle.vEdge1, P);
+
+			//the shared direction is parallel to the triangle
+			if (FMath::Abs(determinant) < SMALL_NUMBER)
+				continue;
+
+			const VectorRegister inverseDeterminant = VectorSetFloat1(1.0f / determinant);
+			const VectorRegister sX = VectorSubtract(origin[0], VectorSetFloat1(triangle.vV0.X));
+			const VectorRegister sY = VectorSubtract(origin[1], VectorSetFloat1(triangle.vV0.Y));
+			const VectorRegister sZ = VectorSubtract(origin[2], VectorSetFloat1(triangle.vV0.Z));
+
+			const VectorRegister U = VectorMultiply(VectorMultiplyAdd(sX, VectorSetFloat1(P.X), VectorMultiplyAdd(sY, VectorSetFloat1(P.Y), VectorMultiply(sZ, VectorSetFloat1(P.Z)))), inverseDeterminant);
+
+			// Q = S x Edge1
+			const VectorRegister e1X = VectorSetFloat1(triangle.vEdge1.X);
+			const VectorRegister e1Y = VectorSetFloat1(triangle.vEdge1.Y);
+			const VectorRegister e1Z = VectorSetFloat1(triangle.vEdge1.Z);
+			const VectorRegister qX = VectorSubtract(VectorMultiply(sY, e1Z), VectorMultiply(sZ, e1Y));
+			const VectorRegister qY = VectorSubtract(VectorMultiply(sZ, e1X), VectorMultiply(sX, e1Z));
+			const VectorRegister qZ = VectorSubtract(VectorMultiply(sX, e1Y), VectorMultiply(sY, e1X));
+
+			const VectorRegister V = VectorMultiply(VectorMultiplyAdd(qX, VectorSetFloat1(direction.X), VectorMultiplyAdd(qY, VectorSetFloat1(direction.Y), VectorMultiply(qZ, VectorSetFloat1(direction.Z)))), inverseDeterminant);
+			const VectorRegister T = VectorMultiply(VectorMultiplyAdd(qX, VectorSetFloat1(triangle.vEdge2.X), VectorMultiplyAdd(qY, VectorSetFloat1(triangle.vEdge2.Y), VectorMultiply(qZ, VectorSetFloat1(triangle.vEdge2.Z)))), inverseDeterminant);
+
+			VectorRegister hitMask = VectorBitwiseAnd(VectorCompareGE(U, zero), VectorCompareGE(V, zero));
+			hitMask = VectorBitwiseAnd(hitMask, VectorCompareGE(one, VectorAdd(U, V)));
+			hitMask = VectorBitwiseAnd(hitMask, VectorCompareGT(T, minDistance));
+			hitMask = VectorBitwiseAnd(hitMask, VectorCompareGT(bestDistance, T));
+
+			bestDistance = VectorSelect(hitMask, T, bestDistance);
+			bestTriangle = VectorSelect(hitMask, VectorSetFloat1((float)triIndex), bestTriangle);
+		}
+	}
+
+	float distances[GeometryPacketSize];
+	float triangleIndices[GeometryPacketSize];
+	VectorStore(bestDistance, distances);
+	VectorStore(bestTriangle, triangleIndices);
+
+	for (int32 rayIndex = 0; rayIndex < rayCount; ++rayIndex)
+	{
+		RayHit& hit = outHits[rayIndex];
+		hit = RayHit();
+
+		if (triangleIndices[rayIndex] < 0.0f)
+			continue;
+
+		const GeometryTriangle& triangle = bvh.triangles[(int32)triangleIndices[rayIndex]];
+		hit.bHit = true;
+		hit.fDistance = distances[rayIndex];
+		hit.vImpact = ToCoreVector(ToFVector(rayStarts[rayIndex]) + direction * distances[rayIndex]);
+
+		//same as a physics trace, the normal faces the ray
+		hit.vNormal = ToCoreVector(FVector::DotProduct(triangle.vNormal, direction) > 0.0f ? -triangle.vNormal : triangle.vNormal);
+	}
+}
+
+void CoverGen::SubmitTraceBatch()
+{
+	SCOPE_CYCLE_COUNTER(STAT_CoverGen_TraceBatches);
+	const int32 maxRays = FMath::Max(_settings.maxRaysPerBatch, 1); //at least one column goes out every frame, or generation would never finish
+	int32 raysSubmitted = 0;
+
+	for (CoverWorkItem* work : _pendingWork)
+	{
+		while (work->nextColumnToSubmit < (int32)work->columns.size() && raysSubmitted < maxRays)
+		{
+			const int32 columnIndex = work->nextColumnToSubmit++;
+			const RayColumn& column = work->columns[columnIndex];
+			std::vector<CoverCore::Vector>& rayStarts = work->columnRayStarts[columnIndex];
+
+			if (rayStarts.empty())
+				CoverCore::GetObjectColumnRayStarts(column, work->sweep, work->bAnalytic, GetCoreSettings(), rayStarts);
+
+			//local traces are cheap enough to resolve right away
+			if (work->bLocalTraces)
+			{
+				TraceColumnLocally(work, column, rayStarts, work->columnHits[columnIndex]);
+				work->columnReady[columnIndex] = true;
+				raysSubmitted += (int32)rayStarts.size();
+				continue;
+			}
+
+			//all rays are traced at full length, ResolveColumn shortens them once the column has a node
+			PendingColumn pending;
+			pending.work = work;
+			pending.columnIndex = columnIndex;
+
+			for (const CoverCore::Vector& rayStart : rayStarts)
+				pending.traceHandles.Add(_pWorld->AsyncLineTraceByChannel(EAsyncTraceType::Single, ToFVector(rayStart), ToFVector(rayStart + column.vDirection * work->sweep.maxDistance), ECC_Visibility));
+
+			raysSubmitted += (int32)rayStarts.size();
+
+			if (pending.traceHandles.Num() == 0)
+				work->columnReady[columnIndex] = true;
+			else
+				_inFlightColumns.Add(pending);
+		}
+
+		if (raysSubmitted >= maxRays)
+			break;
+	}
+}
+
+void CoverGen::CollectTraceBatch()
+{
+	SCOPE_CYCLE_COUNTER(STAT_CoverGen_TraceBatches);
+	TArray<PendingColumn> stillInFlight;
+
+	for (PendingColumn& pending : _inFlightColumns)
+	{
+		CoverWorkItem* work = pending.work;
+		std::vector<RayHit> hits(pending.traceHandles.Num());
+		bool bAllReady = true;
+		bool bExpired = false;
+
+		for (int32 rayIndex = 0; rayIndex < pending.traceHandles.Num(); ++rayIndex)
+		{
+			FTraceDatum traceData;
+
+			if (!_pWorld->QueryTraceData(pending.traceHandles[rayIndex], traceData))
+			{
+				bAllReady = false;
+				bExpired = !_pWorld->IsTraceHandleValid(pending.traceHandles[rayIndex], false);
+				break;
+			}
 
-					//############################ END cover from geometry ############################//
+			if (traceData.OutHits.Num() > 0 && traceData.OutHits[0].bBlockingHit)
+			{
+				const FHitResult& hitResult = traceData.OutHits[0];
+				const AActor* hitActor = hitResult.Actor.Get();
 
-					MargeNodesInProximity(ptrCurrentCoverObject, spacing / 2.0f, true);
+				if (hitActor && hitActor->GetUniqueID() == work->actorUniqueID)
+				{
+					hits[rayIndex].bHit = true;
+					hits[rayIndex].vImpact = ToCoreVector(hitResult.ImpactPoint);
+					hits[rayIndex].vNormal = ToCoreVector(hitResult.Normal);
+					hits[rayIndex].fDistance = hitResult.Distance;
 				}
+			}
+		}
 
-				// OPTION 2 - use bounding box for cover generation (simple)
-				else
-				{
-					//TODO: fix the min bounding box
-					const FVector leftFront = FVector((boundingBoxCenter.X - sizeHalfed.X), boundingBoxCenter.Y - sizeHalfed.Y, boundingBoxCenter.Z);
-					const FVector rightFront = FVector((boundingBoxCenter.X - sizeHalfed.X), boundingBoxCenter.Y + sizeHalfed.Y, boundingBoxCenter.Z);
-					const FVector leftBack = FVector((boundingBoxCenter.X + sizeHalfed.X), boundingBoxCenter.Y - sizeHalfed.Y, boundingBoxCenter.Z);
-					const FVector rightBack = FVector((boundingBoxCenter.X + sizeHalfed.X), boundingBoxCenter.Y + sizeHalfed.Y, boundingBoxCenter.Z);
-					
-					//shoot at different heights
-					if(fTopOfTheBoundingBox < 50000.0f)
-					{
-						FVector vNormal; // vector to store our normal
-
-						//shoot multiple rays from 4 directions:
-						//############ on Y axis front ############//
-						for (float offset = 0.0f; leftFront.Y + offset <= rightFront.Y; offset += spacing)
-						{
-							int currentMissCount = 0;
-							CoverNode* currentCoverNode = nullptr;
-
-							for (float heightOffset = minCover; fBottomOfTheBoundingBox + heightOffset <= fTopOfTheBoundingBox; heightOffset += spacing)
-							{
-								float currentHeight = fBottomOfTheBoundingBox + heightOffset;
-								FVector pos = FVector(leftFront.X - LargeOffset, leftFront.Y + offset, currentHeight);
-								
-								if (isVecHeightInBounds(fBottomOfTheBoundingBox, pos, minCover, maxCover) && currentMissCount <= missAcceptance)
-								{
-									float maxRayDistance = currentCoverNode ? FVector::Distance(currentCoverNode->GetPosition(), pos) + spacing : maxDistance;
-
-									FVector hitRes = RayHitTest(pos, pos.ForwardVector, maxRayDistance, actor, vNormal);
-
-									if (hitRes != FVector::ZeroVector)
-									{
-										//only create the first cover node
-										if(!currentCoverNode)
-											currentCoverNode = ptrCurrentCoverObject->AddNewCoverPoint(hitRes, vNormal);
-
-										else
-											currentCoverNode->_fHeight = hitRes.Z;
-
-#if DrawMissedRays == 1 || DrawMissedRays == 5
-										DrawDebugSphere(_pWorld, pos, 1.5f, 2, FColor::Green, true);
-#endif
-										currentMissCount = 0;
-									}
-
-									else
-									{
-										currentMissCount++;
-#if DrawMissedRays == 1 || DrawMissedRays == 5
-										DrawDebugSphere(_pWorld, pos, 1.5f, 2, FColor::Red, true);
-										DrawDebugLine(_pWorld, pos, FVector(pos.X + 1.0f + maxRayDistance, pos.Y, pos.Z), FColor::Red, true);
-#endif
-									}
-								}
-								else break;
-							}
-						}
-
-						//############ on X axis right ############//
-						for (float offset = 0.0f; rightFront.X + offset <= rightBack.X; offset += spacing)
-						{
-							int currentMissCount = 0;
-							CoverNode* currentCoverNode = nullptr;
-
-							for (float heightOffset = minCover; fBottomOfTheBoundingBox + heightOffset <= fTopOfTheBoundingBox; heightOffset += spacing)
-							{
-								float currentHeight = fBottomOfTheBoundingBox + heightOffset;
-								FVector pos = FVector(rightFront.X + offset, rightFront.Y + LargeOffset, currentHeight);
-
-								if (isVecHeightInBounds(fBottomOfTheBoundingBox, pos, minCover, maxCover) && currentMissCount <= missAcceptance)
-								{
-									float maxRayDistance = currentCoverNode ? FVector::Distance(currentCoverNode->GetPosition(), pos) + spacing : maxDistance;
-
-									FVector hitRes = RayHitTest(pos, pos.LeftVector, maxRayDistance, actor, vNormal);
-									
-
-									if (hitRes != FVector::ZeroVector)
-									{
-										//only create the first cover node
-										if (!currentCoverNode)
-											currentCoverNode = ptrCurrentCoverObject->AddNewCoverPoint(hitRes, vNormal);
-
-										else
-											currentCoverNode->_fHeight = hitRes.Z;
-
-#if DrawMissedRays == 4 || DrawMissedRays == 5
-										DrawDebugSphere(_pWorld, pos, 1.5f, 2, FColor::Green, true);
-#endif
-										currentMissCount = 0;
-									}
-
-									else
-									{
-										currentMissCount++;
-#if DrawMissedRays == 4 || DrawMissedRays == 5
-										DrawDebugSphere(_pWorld, pos, 1.5f, 2, FColor::Red, true);
-										DrawDebugLine(_pWorld, pos, FVector(pos.X, pos.Y - 1.0f - maxRayDistance, pos.Z), FColor::Red, true);
-#endif
-									}
-								}
-								else break;
-							}
-						}
-
-						//############ on Y axis back ############//
-						for (float offset = 0; leftBack.Y <= rightBack.Y - offset; offset += spacing)
-						{
-							int currentMissCount = 0;
-							CoverNode* currentCoverNode = nullptr;
-
-							for (float heightOffset = minCover; fBottomOfTheBoundingBox + heightOffset <= fTopOfTheBoundingBox; heightOffset += spacing)
-							{
-								float currentHeight = fBottomOfTheBoundingBox + heightOffset;
-								FVector pos = FVector(rightBack.X + LargeOffset, rightBack.Y - offset, currentHeight);
-
-								if (isVecHeightInBounds(fBottomOfTheBoundingBox, pos, minCover, maxCover) && currentMissCount <= missAcceptance)
-								{
-									float maxRayDistance = currentCoverNode ? FVector::Distance(currentCoverNode->GetPosition(), pos) + spacing : maxDistance;
-
-									FVector hitRes = RayHitTest(pos, pos.BackwardVector, maxRayDistance, actor, vNormal);
-									//DrawDebugSphere(_pWorld, pos, 6.5f, 2, FColor::Orange, true);
-
-									if (hitRes != FVector::ZeroVector)
-									{
-										//only create the first cover node
-										if (!currentCoverNode)
-											currentCoverNode = ptrCurrentCoverObject->AddNewCoverPoint(hitRes, vNormal);
-
-										else
-											currentCoverNode->_fHeight = hitRes.Z;
-
-#if DrawMissedRays == 3 || DrawMissedRays == 5
-										DrawDebugSphere(_pWorld, pos, 1.5f, 2, FColor::Green, true);
-#endif
-										currentMissCount = 0;
-									}
-
-									else
-									{
-										currentMissCount++;
-#if DrawMissedRays == 3 || DrawMissedRays == 5
-										DrawDebugSphere(_pWorld, pos, 1.5f, 2, FColor::Red, true);
-										DrawDebugLine(_pWorld, pos, FVector(pos.X - 1.0f - maxRayDistance, pos.Y, pos.Z), FColor::Red, true);
-#endif
-									}
-								}
-								else break;
-							}
-						}
-						//_________ Y axis end _________//
-
-						//############ on X axis left ############//
-						for (float offset = 0; leftFront.X <= leftBack.X - offset; offset += spacing)
-						{
-							int currentMissCount = 0;
-							CoverNode* currentCoverNode = nullptr;
-
-							for (float heightOffset = minCover; fBottomOfTheBoundingBox + heightOffset <= fTopOfTheBoundingBox; heightOffset += spacing)
-							{
-								float currentHeight = fBottomOfTheBoundingBox + heightOffset;
-								FVector pos = FVector(leftBack.X - offset, leftBack.Y - LargeOffset, currentHeight);
-
-								if (isVecHeightInBounds(fBottomOfTheBoundingBox, pos, minCover, maxCover) && currentMissCount <= missAcceptance)
-								{
-									float maxRayDistance = currentCoverNode ? FVector::Distance(currentCoverNode->GetPosition(), pos) + spacing : maxDistance;
-
-									FVector hitRes = RayHitTest(pos, pos.RightVector, maxRayDistance, actor, vNormal);
-									//DrawDebugSphere(_pWorld, pos, 6.5f, 2, FColor::Magenta, true);
-
-									if (hitRes != FVector::ZeroVector)
-									{
-										//only create the first cover node
-										if (!currentCoverNode)
-											currentCoverNode = ptrCurrentCoverObject->AddNewCoverPoint(hitRes, vNormal);
-
-										else
-											currentCoverNode->_fHeight = hitRes.Z;
-
-#if DrawMissedRays == 2 || DrawMissedRays == 5
-										DrawDebugSphere(_pWorld, pos, 1.5f, 2, FColor::Green, true);
-#endif
-										currentMissCount = 0;
-									}
-
-									else
-									{
-										currentMissCount++;
-#if DrawMissedRays == 2 || DrawMissedRays == 5
-										DrawDebugSphere(_pWorld, pos, 1.5f, 2, FColor::Red, true);
-										DrawDebugLine(_pWorld, pos, FVector(pos.X, pos.Y + 1.0f + maxRayDistance, pos.Z), FColor::Red, true);
-#endif
-									}
-								}
-								else break;
-							}
-						}
+		if (bAllReady)
+		{
+			work->columnHits[pending.columnIndex] = std::move(hits);
+			work->columnReady[pending.columnIndex] = true;
+		}
 
-					}
-					MargeNodesInProximity(ptrCurrentCoverObject, spacing - 1.0f, false);
-				}
+		//results were dropped before we read them, trace the column again
+		else if (bExpired)
+		{
+			const RayColumn& column = work->columns[pending.columnIndex];
+			pending.traceHandles.Empty();
 
-				//Optimize cover
-				RemoveUpAndDownNodes(ptrCurrentCoverObject, 0.9f);
+			for (const CoverCore::Vector& rayStart : work->columnRayStarts[pending.columnIndex])
+				pending.traceHandles.Add(_pWorld->AsyncLineTraceByChannel(EAsyncTraceType::Single, ToFVector(rayStart), ToFVector(rayStart + column.vDirection * work->sweep.maxDistance), ECC_Visibility));
 
-				//if(actor->ActorHasTag("TEST"))
-				if(ptrCurrentCoverObject->GetAllCoverNodes().Num() > 5 && !(actor->ActorHasTag("NoCoverOptimization")))
-				{
-					if(actor->ActorHasTag("CoverFromGeometry"))
-						OrganizeCoverNodesByDistance(ptrCurrentCoverObject);
+			stillInFlight.Add(pending);
+		}
 
-					OptimizeCoverNodes(ptrCurrentCoverObject, spacing);
-				}
+		else
+			stillInFlight.Add(pending);
+	}
 
-				//Set proper height value
-				for (auto node : ptrCurrentCoverObject->GetAllCoverNodes())
-					node->_fHeight = node->_fHeight - node->GetPosition().Z;
+	_inFlightColumns = MoveTemp(stillInFlight);
+}
 
-				if (actor->ActorHasTag("TEST2_"))
-					CreateTriggerBoxData(ptrCurrentCoverObject);
-			}
+void CoverGen::ResolveReadyColumns()
+{
+	TArray<CoverWorkItem*> stillPending;
+	TArray<CoverWorkItem*> finishedWork;
+
+	for (CoverWorkItem* work : _pendingWork)
+	{
+		//columns are resolved in order so nodes are created in the same order as with synchronous traces
+		while (work->nextColumnToResolve < (int32)work->columns.size() && work->columnReady[work->nextColumnToResolve])
+		{
+			const int32 columnIndex = work->nextColumnToResolve++;
+			COVER_PHASE_SCOPE(work, RaySweeps);
+			ResolveColumn(work, work->columns[columnIndex], work->columnRayStarts[columnIndex], &work->columnHits[columnIndex]);
+
+			std::vector<CoverCore::Vector>().swap(work->columnRayStarts[columnIndex]);
+			std::vector<RayHit>().swap(work->columnHits[columnIndex]);
 		}
 
-#if VisualDebug > 0 && VisualDebug < 3
-		DebugDrawAllCoverNodes();
-#endif
+		if (work->nextColumnToResolve == (int32)work->columns.size())
+			finishedWork.Add(work);
+
+		else
+			stillPending.Add(work);
 	}
+
+	_pendingWork = MoveTemp(stillPending);
+	RunCoverWork(finishedWork, false);
 }
 
 CoverGen::CoverActors* CoverGen::GetActorsWithCoverFlagInTheScene()
@@ -555,34 +2431,31 @@ CoverGen::CoverActors* CoverGen::GetActorsWithCoverFlagInTheScene()
 
 FVector CoverGen::RayHitTest(FVector StartTrace, FVector ForwardVector, float MaxDistance, AActor* ActorTested, FVector& outNormal, FColor rayDebugColor)
 {
-	FHitResult* HitResult = new FHitResult();
-	FVector EndTrace = ForwardVector * MaxDistance + StartTrace;
-	FCollisionQueryParams* TraceParams = new FCollisionQueryParams();
+	//one of these runs per ray, both live on the stack
+	FHitResult HitResult;
+	const FVector EndTrace = ForwardVector * MaxDistance + StartTrace;
+	const FCollisionQueryParams TraceParams;
 
-	if (_pWorld->LineTraceSingleByChannel(*HitResult, StartTrace, EndTrace, ECC_Visibility, *TraceParams))
+	if (_pWorld->LineTraceSingleByChannel(HitResult, StartTrace, EndTrace, ECC_Visibility, TraceParams))
 	{
-		if(HitResult->Actor.Get()->GetUniqueID() == ActorTested->GetUniqueID())
+		const AActor* hitActor = HitResult.Actor.Get();
+		if (hitActor && hitActor->GetUniqueID() == ActorTested->GetUniqueID())
 		{
-#if VisualDebug > 0
 				//DrawDebugLine    (_pWorld, StartTrace, EndTrace, FColor(255, 0, 0), true);
 			//DrawDebugLine(_pWorld, StartTrace, HitResult->ImpactPoint, rayDebugColor, true);
 			//DrawDebugSphere  (_pWorld, StartTrace, 2.5f, 5, FColor::Blue, true);
 			//DrawDebugSphere  (_pWorld, HitResult->ImpactPoint, 2.5f, 5, FColor::Green, true); // hit result
 				//DrawDebugString(_pWorld, HitResult->ImpactPoint, (TEXT("Actor Hit: %s"), HitResult->Actor->GetName()));
-#endif // VisualDebug
 
-			outNormal = HitResult->Normal;
-			return HitResult->ImpactPoint;
+			outNormal = HitResult.Normal;
+			return HitResult.ImpactPoint;
 		}
 	}
 
-
-	delete HitResult;
-	delete TraceParams;
 	return FVector(0.0f, 0.0f, 0.0f);
 }
 
-inline void CoverGen::DrawBoundingBoxEdges(AActor*& actorRef)
+inline void CoverGen::DrawBoundingBoxEdges(AActor*& actorRef, int32 objectID)
 {
 	//		Z
 	//		|
@@ -591,7 +2464,10 @@ inline void CoverGen::DrawBoundingBoxEdges(AActor*& actorRef)
 	//		|/________ Y
 
 	//CALCULATE FACING X
-#if VisualDebug == 4
+	CoverDebugShapes* debugShapes = GetDebugShapes(objectID, CDC_Geometry);
+	if (!debugShapes)
+		return;
+
 	const FVector center = actorRef->GetComponentsBoundingBox().GetCenter();
 	const FVector sizeHalfed   = actorRef->GetComponentsBoundingBox().GetSize() / 2.0f;
 
@@ -600,59 +2476,29 @@ inline void CoverGen::DrawBoundingBoxEdges(AActor*& actorRef)
 	const FVector leftBack   = FVector((center.X + sizeHalfed.X), center.Y - sizeHalfed.Y, center.Z);
 	const FVector rightBack  = FVector((center.X + sizeHalfed.X), center.Y + sizeHalfed.Y, center.Z);
 
-	DrawDebugSphere(_pWorld, leftFront,  2.5f, 5, FColor::Purple, true);
-	DrawDebugSphere(_pWorld, rightFront, 2.5f, 5, FColor::Purple, true);
-	DrawDebugSphere(_pWorld, leftBack,   2.5f, 5, FColor::Purple, true);
-	DrawDebugSphere(_pWorld, rightBack,  2.5f, 5, FColor::Purple, true);
+	debugShapes->AddPoint(CDC_Geometry, leftFront,  5.0f, FColor::Purple);
+	debugShapes->AddPoint(CDC_Geometry, rightFront, 5.0f, FColor::Purple);
+	debugShapes->AddPoint(CDC_Geometry, leftBack,   5.0f, FColor::Purple);
+	debugShapes->AddPoint(CDC_Geometry, rightBack,  5.0f, FColor::Purple);
 
-	DrawDebugLine(_pWorld, leftFront, rightFront, FColor::Purple, true);
-	DrawDebugLine(_pWorld, leftFront, leftBack,   FColor::Purple, true);
-	DrawDebugLine(_pWorld, leftBack, rightBack,   FColor::Purple, true);
-	DrawDebugLine(_pWorld, rightFront, rightBack, FColor::Purple, true);
+	debugShapes->AddLine(CDC_Geometry, leftFront, rightFront, FColor::Purple);
+	debugShapes->AddLine(CDC_Geometry, leftFront, leftBack,   FColor::Purple);
+	debugShapes->AddLine(CDC_Geometry, leftBack, rightBack,   FColor::Purple);
+	debugShapes->AddLine(CDC_Geometry, rightFront, rightBack, FColor::Purple);
 
 	//DrawDebugString( _pWorld, leftFront,  TEXT("Left Front")  );
 	//DrawDebugString( _pWorld, rightFront, TEXT("Right Front") );
 	//DrawDebugString( _pWorld, leftBack,   TEXT("Left Back")   );
 	//DrawDebugString( _pWorld, rightBack,  TEXT("Right Back")  );
-#endif // !VisualDebug
-}
-
-inline void CoverGen::DebugCheckForDuplicates(CoverObject*& coverObject)
-{
-	TArray<CoverNode*> duplicates;
-	for (int indexCurrentNode = 0; indexCurrentNode < coverObject->GetAllCoverNodes().Num(); ++indexCurrentNode)
-	{
-		CoverNode* cCurrentNode = coverObject->GetAllCoverNodes()[indexCurrentNode];
-
-		for (int indexTestedNode = indexCurrentNode + 1; indexTestedNode < coverObject->GetAllCoverNodes().Num(); ++indexTestedNode)
-		{
-			CoverNode* cTestedNode = coverObject->GetAllCoverNodes()[indexTestedNode];
-
-			if (cCurrentNode == cTestedNode)
-				duplicates.Add(cTestedNode);
-		}
-	}
-
-	ensureMsgf(duplicates.Num() == 0, TEXT("There was %i node duplicates"), duplicates.Num());
 }
 
-inline void CoverGen::RemoveUpAndDownNodes(CoverObject*& _coverObject, float maxUp)
+inline void CoverGen::GetNodesInRadius(CoverObject*& _coverObject, FVector _searchPos, float _searchRadius, TArray<CoverNodeHandle>& _outCoverNodesFound)
 {
-	TArray<CoverNode*> nodesToBeDelted;
-
-	for (auto node : _coverObject->GetAllCoverNodes())
-		if (node->GetNormal().Z > maxUp || node->GetNormal().Z < -maxUp)
-			nodesToBeDelted.Add(node);
+	const CoverNodeStore& nodes = _coverObject->_nodes;
 
-	if(nodesToBeDelted.Num() > 0)
-		_coverObject->RemoveCoverNodes(nodesToBeDelted);
-}
-
-inline void CoverGen::GetNodesInRadius(CoverObject*& _coverObject, FVector _searchPos, float _searchRadius, TArray<CoverNode*>& _outCoverNodesFound)
-{
-	for(CoverNode* coverNode : _coverObject->GetAllCoverNodes())
+	for(CoverNodeHandle coverNode = 0; coverNode < nodes.Num(); ++coverNode)
 	{
-		float distance = FVector::Distance(_searchPos, coverNode->GetPosition());
+		float distance = FVector::Distance(_searchPos, nodes.GetPosition(coverNode));
 		if(distance <= _searchRadius)
 		{
 			_outCoverNodesFound.Add(coverNode);
@@ -686,84 +2532,6 @@ inline FVector CoverGen::CalculateCenterOfATriangle(FVector& p1, FVector& p2, FV
 
 }
 
-inline void CoverGen::SortArrayByLowestHeight(TArray<FVector>& arr)
-{
-	for(int index1 = 0; index1 < arr.Num() - 1; ++index1)
-	{
-		for (int index2 = index1 + 1; index2 < arr.Num(); ++index2)
-		{
-			if(arr[index1].Z > arr[index2].Z)
-			{
-				arr.Swap(index1, index2);
-			}
-		}
-	}
-}
-
-inline TArray<FVector> CoverGen::GetActorsVertexPositon(AActor* actor)
-{
-	TArray<FVector> VArr;
-
-	//if (actor->ActorHasTag("TEST"))
-	{
-		UStaticMeshComponent* tempMesh = actor->FindComponentByClass<UStaticMeshComponent>();
-
-		if (tempMesh)
-		{
-			UStaticMesh* ptrUSM = tempMesh->GetStaticMesh();
-
-			if (ptrUSM)
-			{
-				if (ptrUSM->RenderData->LODResources.Num() > 0)
-				{
-					FPositionVertexBuffer* VertexBuffer = &(ptrUSM->RenderData->LODResources[0].VertexBuffers.PositionVertexBuffer);
-
-					if (VertexBuffer)
-					{
-						const int32 VertexCount = VertexBuffer->GetNumVertices();
-						//DrawDebugString(_pWorld, actor->GetActorLocation(), TEXT("VertexCount = ") + FString::FromInt(VertexCount));
-						for (int32 Index = 0; Index < VertexCount; Index++)
-						{
-							//This is in the Static Mesh Actor Class, so it is location and transform of the SMActor
-							const FVector WorldSpaceVertexLocation = actor->GetActorLocation() + actor->GetTransform().TransformVector(VertexBuffer->VertexPosition(Index));
-						
-							//add to output FVector array
-
-							//Unique check
-							bool isUnique = true;
-							for (FVector vec : VArr)
-							{
-								if (FVector::Distance(WorldSpaceVertexLocation, vec) < 1.0f)
-								{
-									isUnique = false;
-									break;
-								}
-							}
-							if (isUnique)
-								VArr.Add(WorldSpaceVertexLocation);
-						}
-
-						//for (int32 Index = 0; Index < VArr.Num(); Index++)
-						//{
-						//	DrawDebugSphere(_pWorld, VArr[Index], 5.0f, 5, FColor::Yellow, true);
-						//
-						//	if (Index != 0)
-						//	{
-						//		DrawDebugLine(_pWorld, VArr[Index], VArr[Index - 1], FColor::Yellow, true);
-						//	}
-						//}
-						//
-						//DrawDebugString(_pWorld, FVector(actor->GetActorLocation().X, actor->GetActorLocation().Y, actor->GetActorLocation().Z + 20.0f), TEXT("Vector Array = ") + FString::FromInt(VArr.Num()));
-
-					}
-				}
-			}
-		}
-	}
-
-	return VArr;
-}
-
 inline bool CoverGen::isTriangleInZRange(float MinZ, float MaxZ, FVector& p1, FVector& p2, FVector& p3)
 {
 	if (p1.Z > MinZ || p2.Z > MinZ || p3.Z > MinZ)
@@ -810,7 +2578,6 @@ inline TArray<FVector> CoverGen::ReconstructAndScaleActorTriangles(AActor* actor
 		VArr.Add(ActorPos + actor->GetTransform().TransformVector(V2));
 	}
 
-#if VisualDebug == 2 ||  VisualDebug == 3
 	//Debug draw our triangles
 	//for (int V = 2; V < VArr.Num(); V += 3)
 	//{
@@ -823,23 +2590,24 @@ inline TArray<FVector> CoverGen::ReconstructAndScaleActorTriangles(AActor* actor
 	//	DrawDebugLine(_pWorld, V0, V2, FColor::Red, true);
 	//	DrawDebugLine(_pWorld, V1, V2, FColor::Red, true);
 	//}
-#endif
 
 	return VArr;
 }
 
-inline CoverGen::CoverNode* CoverGen::GetLowestNodeInPosition(CoverObject*& _coverObject, FVector2D _searchPos, float _posErrorAcceptance)
+inline CoverGen::CoverNodeHandle CoverGen::GetLowestNodeInPosition(CoverObject*& _coverObject, FVector2D _searchPos, float _posErrorAcceptance)
 {
+	const CoverNodeStore& nodes = _coverObject->_nodes;
 	const float zStart = _coverObject->GetLocation().Z - _coverObject->GetSize().Z / 2.0f;
 	const float zEnd   = _coverObject->GetLocation().Z + _coverObject->GetSize().Z / 2.0f;
 	
 	for(float Z = zStart; Z < zEnd; ++Z)
 	{
-		for(CoverNode* coverNode : _coverObject->GetAllCoverNodes())
+		for(CoverNodeHandle coverNode = 0; coverNode < nodes.Num(); ++coverNode)
 		{
-			if(coverNode->GetPosition().Z == Z)
+			const FVector position = nodes.GetPosition(coverNode);
+			if(position.Z == Z)
 			{
-				float distance = FVector2D::Distance(FVector2D(coverNode->GetPosition().X, coverNode->GetPosition().Y), _searchPos);
+				float distance = FVector2D::Distance(FVector2D(position.X, position.Y), _searchPos);
 
 				if(distance <= _posErrorAcceptance)
 				{
@@ -849,59 +2617,60 @@ inline CoverGen::CoverNode* CoverGen::GetLowestNodeInPosition(CoverObject*& _cov
 		}
 	}
 
-	return nullptr;
+	return INDEX_NONE;
 }
 
-void CoverGen::CreateTriggerBoxData(CoverObject*& _coverObject)
+void CoverGen::CreateOccupancyBoxes(CoverObject*& _coverObject)
 {
-	int index = 0;
-	for(auto node : _coverObject->GetAllCoverNodes())
-	{
-		if(node->_bConnectedNode)
-		{
-			//auto node = _coverObject->GetAllCoverNodes()[0];
-
-			const FRotator* rot = new FRotator(0.0f, 0.0f, 0.0f);//create temp rotator
-			AActor* tBoxA = _pWorld->SpawnActor(ACoverTriggerBox::StaticClass(), &node->_VPosition, rot); //spawn trigger box in the world
-			delete rot; //delete temp rotator
+	CoverNodeStore& nodes = _coverObject->_nodes;
 
-			//tBoxA->SetActorScale3D(FVector(0.1f, 0.1f, 0.1f));
-			//tBoxA->SetActorRelativeScale3D(FVector(0.1f, 0.1f, 0.1f));
-			// 
-			//ACoverTriggerBox* triggerBox = dynamic_cast<ACoverTriggerBox*>(tBoxA); // also works but will use UE4 version ACoverTriggerBox* triggerBox = Cast<ACoverTriggerBox>(tBoxA)
-
-			if (ACoverTriggerBox* triggerBox = Cast<ACoverTriggerBox>(tBoxA))
-			{
-				node->_triggerBox = triggerBox;
-				
-				if(index < _coverObject->GetAllCoverNodes().Num() - 1)
-					SetTriggerBoxTransform(triggerBox, node, _coverObject->GetAllCoverNodes()[index + 1], _coverObject->_vScale);
-
-				triggerBox->DebugDrawTriggerBox();
-			}
-			else
-			{
-				UE_LOG(LogTemp, Error, TEXT("dynamic cast to ACoverTriggerBox was unsuccessful. Object: %s, NodeID: %d"), *_coverObject->_Name, node->_iIndex);
-				delete tBoxA; // we can't convert back to ACoverTriggerBox so we don't need this object anymore.
-			}
+	//one box in front of every edge of a segment, the last node of a segment doesn't get one
+	for (int32 segmentIndex = 0; segmentIndex < nodes.NumSegments(); ++segmentIndex)
+	{
+		const CoverCore::CoverSegment& segment = nodes.GetSegment(segmentIndex);
+		float startDistance = 0.0f;
 
-			index++;
+		for (CoverNodeHandle node = segment.firstNode; node < segment.firstNode + segment.nodeCount - 1; ++node)
+		{
+			CoverOccupancyBox occupancyBox;
+			occupancyBox.nodeRef.objectID = _coverObject->_ID;
+			occupancyBox.nodeRef.node = segment.firstSlot;
+			occupancyBox.slotCount = segment.slotCount;
+			occupancyBox.fStartDistance = startDistance;
+			occupancyBox.fSlotStep = segment.GetSlotStep();
+			SetOccupancyBoxTransform(occupancyBox, nodes, node, node + 1, _coverObject->_vScale);
+
+			nodes._occupancyBoxes[node] = AddOccupancyBox(occupancyBox);
+			startDistance += FVector::Dist(nodes.GetPosition(node), nodes.GetPosition(node + 1));
 		}
 	}
 }
 
-inline void CoverGen::SetTriggerBoxTransform(ACoverTriggerBox* triggerBox, CoverNode* currentNode, CoverNode* nextNode, const FVector objectsScale)
+CoverNodeRef CoverGen::GetOccupiedSlot(const CoverOccupancyBox& occupancyBox, const FVector& vLocalLocation)
+{
+	//box's X runs along the edge from its start node
+	const float distance = occupancyBox.fStartDistance + FMath::Clamp(vLocalLocation.X + occupancyBox.vExtent.X, 0.0f, occupancyBox.vExtent.X * 2.0f);
+	const int32 slot = occupancyBox.fSlotStep > 0.0f ? FMath::Clamp(FMath::RoundToInt(distance / occupancyBox.fSlotStep), 0, occupancyBox.slotCount - 1) : 0;
+
+	CoverNodeRef nodeRef = occupancyBox.nodeRef;
+	nodeRef.node += slot;
+	return nodeRef;
+}
+
+inline void CoverGen::SetOccupancyBoxTransform(CoverOccupancyBox& occupancyBox, const CoverNodeStore& nodes, CoverNodeHandle currentNode, CoverNodeHandle nextNode, const FVector objectsScale)
 {
-	const float triggerBoxExtent = 50.0f; //how far do we want to extent our trigger box
-	const FVector2D cNodePos = FVector2D(currentNode->GetPosition().X, currentNode->GetPosition().Y);
-	const FVector2D nNodePos = FVector2D(nextNode->GetPosition().X, nextNode->GetPosition().Y);
+	const float occupancyBoxExtent = 50.0f; //how far do we want to extent our occupancy box
+	const FVector currentNodePosition = nodes.GetPosition(currentNode);
+	const FVector nextNodePosition = nodes.GetPosition(nextNode);
+	const FVector2D cNodePos = FVector2D(currentNodePosition.X, currentNodePosition.Y);
+	const FVector2D nNodePos = FVector2D(nextNodePosition.X, nextNodePosition.Y);
 	const float distanceToNextNode = FVector2D::Distance(cNodePos, nNodePos);
-	FVector nodeDifference = nextNode->GetPosition() - currentNode->GetPosition();
+	FVector nodeDifference = nextNodePosition - currentNodePosition;
 	nodeDifference.Normalize();
 
 
-	FVector tBoxLoc = currentNode->GetPosition() + (nodeDifference * (distanceToNextNode / 2.0f)); //set to the middle point between two cover points
-	tBoxLoc.Z += currentNode->GetHeight() / 2.0f; //move up
+	FVector tBoxLoc = currentNodePosition + (nodeDifference * (distanceToNextNode / 2.0f)); //set to the middle point between two cover points
+	tBoxLoc.Z += nodes.GetHeight(currentNode) / 2.0f; //move up
 
 	FRotator tBoxFacingDirectionRot = nodeDifference.Rotation();
 	
@@ -914,453 +2683,225 @@ inline void CoverGen::SetTriggerBoxTransform(ACoverTriggerBox* triggerBox, Cover
 	FVector tBoxFacingDirectionVec = tBoxFacingDirectionRot.Vector();
 	tBoxFacingDirectionVec.Normalize();
 
-	//FVector normals = currentNode->GetNormal() + nextNode->GetNormal();
+	//FVector normals = nodes.GetNormal(currentNode) + nodes.GetNormal(nextNode);
 	//normals.Normalize();
 	//DrawDebugDirectionalArrow(_pWorld, tBoxLoc, tBoxLoc + normals * 100.0f, 5.0f, FColor::Red, true);//this would be a good method of finding corners
-	DrawDebugDirectionalArrow(_pWorld, tBoxLoc, tBoxLoc + tBoxFacingDirectionVec * 20.0f, 5.0f, FColor::Yellow, true);	
 
-	tBoxLoc += tBoxFacingDirectionVec * triggerBoxExtent;
-	triggerBox->SetActorLocationAndRotation(tBoxLoc, nodeDifference.ToOrientationQuat());
+	tBoxLoc += tBoxFacingDirectionVec * occupancyBoxExtent;
+	occupancyBox.vCenter = tBoxLoc;
+	occupancyBox.qRotation = nodeDifference.ToOrientationQuat();
 	
 	
 	//SET SIZE
-	if (UBoxComponent* triggerBoxShape = triggerBox->FindComponentByClass<UBoxComponent>())
-	{
-		triggerBoxShape->SetBoxExtent(FVector(distanceToNextNode / 2.0f, triggerBoxExtent, 10.0f));
-	}
+	occupancyBox.vExtent = FVector(distanceToNextNode / 2.0f, occupancyBoxExtent, 10.0f);
 }
 
-inline void CoverGen::OrganizeCoverNodesByDistance(CoverObject*& _coverObject)
+void CoverGen::CoverDebugShapes::AddLine(uint8 category, const FVector& vStart, const FVector& vEnd, const FColor& color)
 {
-	//auto nodes = _coverObject->GetAllCoverNodes();
-	//
-	//DrawDebugSphere(_pWorld, nodes[0]->GetPosition(), 5.0f, 11, FColor::Green, true);
-	//DrawDebugSphere(_pWorld, nodes[0]->GetPosition(), 11.0f, 11, FColor::Magenta, true);
+	lines.Add({ vStart, vEnd, color, category });
 }
 
-inline void CoverGen::OptimizeCoverNodes(CoverObject*& _coverObject, float _spacing)
+void CoverGen::CoverDebugShapes::AddArrow(uint8 category, const FVector& vStart, const FVector& vEnd, float fArrowSize, const FColor& color)
 {
-	TArray<CoverNode*> Nodes;
-
-	CoverNode* nodeZero = _coverObject->GetAllCoverNodes()[0];
-	nodeZero->_bMainNode = true;
-	Nodes.Add(nodeZero);
-	float searchDistance = 0.1f;
-	UE_LOG(LogTemp, Warning, TEXT("Object: %d"), _coverObject->_ID);
-	DrawDebugSphere(_pWorld, nodeZero->GetPosition() + FVector::UpVector * 3.0f, 1.0f, 2, FColor::Red, true);
-	float maxNormal = 0.1f;
-	const int32 numberOfCoverNodes = _coverObject->GetAllCoverNodes().Num();
-	
-	int timeoutCheck = 0;
-	while (Nodes.Num() < numberOfCoverNodes)
-	{
-		if (timeoutCheck > 5000)
-		{
-			UE_LOG(LogTemp, Warning, TEXT("There was a hole in the geometry. Trying to find a new base node."));
-
-			//Find a different node as there's probably a hole in the geometry
-			for (auto node : _coverObject->GetAllCoverNodes())
-				if (!Nodes.Contains(node))
-				{
-					nodeZero = node;
-					node->_bMainNode = true;
-					timeoutCheck = 0;
-					DrawDebugSphere(_pWorld, node->GetPosition() + FVector::UpVector * 3.0f, 1.0f, 2, FColor::Yellow, true);
-					DrawDebugSphere(_pWorld, node->GetPosition() + FVector::UpVector * 100.0f, 1.0f, 2, FColor::Yellow, true);
-					break;
-				}
+	AddLine(category, vStart, vEnd, color);
 
+	//same head as DrawDebugDirectionalArrow
+	const FVector vDirection = (vEnd - vStart).GetSafeNormal();
+	FVector vUp = FVector::UpVector;
+	FVector vRight = FVector::CrossProduct(vDirection, vUp);
 
-			if(timeoutCheck != 0)
-			{
-				UE_LOG(LogTemp, Error, TEXT("there was a hole in the geometry and no replacement for \"a new cover zero\" node was found in %s !" ), *(_coverObject->GetName()));
-				DrawDebugSphere(_pWorld, _coverObject->GetLocation() + FVector::UpVector * 500.0f, 1.0f, 2, FColor::Red, true);
-				return;
-			}
-		}
+	if (!vRight.Normalize())
+		vDirection.FindBestAxisVectors(vUp, vRight);
 
-		timeoutCheck++;
+	const float headSize = FMath::Sqrt(fArrowSize);
+	AddLine(category, vEnd, vEnd + (vRight - vDirection) * headSize, color);
+	AddLine(category, vEnd, vEnd - (vRight + vDirection) * headSize, color);
+}
 
-		for (float index = 1; index < numberOfCoverNodes; ++index)
-		{
-			CoverNode* currentNode = _coverObject->GetAllCoverNodes()[index];
-			float currentDistance  = FVector::Distance(nodeZero->GetPosition(), currentNode->GetPosition());
-			FVector vNormal = nodeZero->GetNormal() - currentNode->GetNormal();
-			
-			if(currentDistance <=  searchDistance && !Nodes.Contains(currentNode) && NormalCheck2D(vNormal, maxNormal))
-			{
-				Nodes.Add(currentNode);
-				//UE_LOG(LogTemp, Warning, TEXT("Distance = %f, searchDistance = %f, normal = %s"), currentDistance, searchDistance, *vNormal.ToString());
-				searchDistance = 0.0f;
-				maxNormal = 0.1f;
-				timeoutCheck = 0;
-				nodeZero->_bConnectedNode = true;
-				nodeZero = currentNode;
-				break;
-			}
-		}
+void CoverGen::CoverDebugShapes::AddPoint(uint8 category, const FVector& vPosition, float fSize, const FColor& color)
+{
+	points.Add({ vPosition, color, fSize, category });
+}
 
-		searchDistance += 0.1f;
-		if (searchDistance > _spacing * 5.0f) { maxNormal += 0.5f; searchDistance = 0.1f; }
+void CoverGen::CoverDebugShapes::AddBox(uint8 category, const FVector& vCenter, const FVector& vExtent, const FQuat& qRotation, const FColor& color)
+{
+	//bit per axis, set - positive side of the box
+	FVector corners[8];
+	for (int32 corner = 0; corner < 8; ++corner)
+	{
+		const FVector vSide((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f);
+		corners[corner] = vCenter + qRotation.RotateVector(vExtent * vSide);
 	}
 
-	//fix index of all nodes <- CopyCoverNodes() is already doing this
-	//for (int i = 0; i < Nodes.Num(); ++i)
-	//	Nodes[i]->_iIndex = i;
-
-	_coverObject->CopyCoverNodes(Nodes);
-	Nodes.Empty();
-
-	float const minDot = 0.6f;
-	float const minHeightDifference = 0.001f;
-	float const minZDifference = 5.0f;
-	float const maxAcceptedDistance = _spacing * 2.0f;
+	//corners that differ on a single axis share an edge
+	for (int32 corner = 0; corner < 8; ++corner)
+		for (int32 axisBit = 1; axisBit < 8; axisBit <<= 1)
+			if (!(corner & axisBit))
+				AddLine(category, corners[corner], corners[corner | axisBit], color);
+}
 
-	//Remove unnecessary nodes
-	for (int index = 1; index < _coverObject->GetAllCoverNodes().Num() - 1; ++index)
-	{
-		CoverNode* pNode = _coverObject->GetAllCoverNodes()[index - 1];
-		CoverNode* cNode = _coverObject->GetAllCoverNodes()[index];
-		CoverNode* fNode = _coverObject->GetAllCoverNodes()[index + 1];
+uint32 CoverGen::_debugDrawEnabledMask = 0;
+FAutoConsoleVariableSink CoverGen::_debugDrawSink(FConsoleCommandDelegate::CreateStatic(&CoverGen::UpdateDebugDrawEnabledMask));
 
-		float distanceToP = abs(FVector::DistXY(cNode->GetPosition(), pNode->GetPosition()));
-		float distanceToF = abs(FVector::DistXY(cNode->GetPosition(), fNode->GetPosition()));
-		float heightDifferenceP = abs(cNode->GetHeight() - pNode->GetHeight());
-		float heightDifferenceF = abs(cNode->GetHeight() - fNode->GetHeight());
-		float zDifferenceP = abs(pNode->GetPosition().Z - cNode->GetPosition().Z);
-		float zDifferenceF = abs(fNode->GetPosition().Z - cNode->GetPosition().Z);
+void CoverGen::UpdateDebugDrawEnabledMask()
+{
+	uint32 mask = 0;
 
-		float DotP = FVector::DotProduct(pNode->GetNormal(), cNode->GetNormal());
-		float DotF = FVector::DotProduct(fNode->GetNormal(), cNode->GetNormal());
+	if (CVarCoverDebugNodes.GetValueOnGameThread() > 0)        mask |= 1 << CDC_Nodes;
+	if (CVarCoverDebugLinks.GetValueOnGameThread() > 0)        mask |= 1 << CDC_Links;
+	if (CVarCoverDebugOptimization.GetValueOnGameThread() > 0) mask |= 1 << CDC_Optimization;
+	if (CVarCoverDebugGeometry.GetValueOnGameThread() > 0)     mask |= 1 << CDC_Geometry;
+	if (CVarCoverDebugMissedRays.GetValueOnGameThread() > 0)   mask |= 1 << CDC_MissedRays;
+	if (CVarCoverDebugOccupancy.GetValueOnGameThread() > 0)    mask |= 1 << CDC_Occupancy;
 
-		//if (_coverObject->GetName() == "HouseCoverTest4" && cNode->_iIndex > 103 && cNode->_iIndex < 117)
-		//{
-		//	DrawDebugString(_pWorld, cNode->GetPosition() - FVector::UpVector * 10.0f, "C:" + FString::SanitizeFloat(cNode->GetHeight()));
-		//	DrawDebugString(_pWorld, cNode->GetPosition() - FVector::UpVector * 20.0f, "P:" + FString::SanitizeFloat(heightDifferenceP));
-		//	DrawDebugString(_pWorld, cNode->GetPosition() - FVector::UpVector * 30.0f, "F:" + FString::SanitizeFloat(heightDifferenceF));
-		//}
+	_debugDrawEnabledMask = mask;
+}
 
-		if (!Nodes.Contains(cNode) && !(cNode->_bMainNode))
-			if (maxAcceptedDistance >= distanceToP && maxAcceptedDistance >= distanceToF)//distance check (X & Y axis only) to prevent gaps that are too long
-				if (DotP > minDot && DotF > minDot)//normal - angle check
-					if (heightDifferenceP < minHeightDifference && heightDifferenceF < minHeightDifference)//height difference check
-						if (zDifferenceP < minZDifference && zDifferenceF < minZDifference)//Z axis difference check
-							Nodes.Add(cNode);
-	}
+CoverGen::CoverDebugShapes* CoverGen::GetDebugShapes(int32 objectID, ECoverDebugCategory category)
+{
+	//recording isn't thread safe, objects generated on worker threads don't get any shapes
+	if (!IsInGameThread() || !(GetDebugDrawMask() & (1 << category)))
+		return nullptr;
 
-	for(auto node : Nodes)
-		DrawDebugSphere(_pWorld, node->GetPosition(), 2.0f, 6, FColor::Red, true);
+	_bDebugDrawDirty = true;
+	return &_debugShapes.FindOrAdd(objectID);
+}
 
-	_coverObject->RemoveCoverNodes(Nodes);
+CoverGen::CoverDebugShapes* CoverGen::GetMissedRayDebugShapes(int32 objectID, int32 debugSide)
+{
+	if (!IsInGameThread() || !(GetDebugDrawMask() & (1 << CDC_MissedRays)))
+		return nullptr;
 
-	//fix index of all nodes
-	for (int i = 0; i < _coverObject->GetAllCoverNodes().Num(); ++i)
-		_coverObject->GetAllCoverNodes()[i]->_iIndex = i;
-	
+	const int32 drawnSide = CVarCoverDebugMissedRays.GetValueOnGameThread();
+	if (drawnSide <= 0 || (drawnSide != 5 && drawnSide != debugSide))
+		return nullptr;
 
-	if (_coverObject->GetAllCoverNodes().Num() > 3)
-	{
-		for (int nodeIndex = 1; nodeIndex < _coverObject->GetAllCoverNodes().Num(); ++nodeIndex)
-		{
-			CoverNode* cNode = _coverObject->GetAllCoverNodes()[nodeIndex];
-			CoverNode* pNode = _coverObject->GetAllCoverNodes()[nodeIndex - 1];
-	
-			//if (cNode->_iIndex > 103 && cNode->_iIndex < 117)
-			{
-				//DrawDebugSphere(_pWorld, cNode->GetPosition(), 6.0f, 2, FColor::Orange, true);
-				//float _spacing_ = nodeIndex % 2 == 0 ? 20.0f : 30.0f;
-				//FString tempTxt = FString::FromInt(pNode->_iIndex) + ">" + FString::FromInt(cNode->_iIndex);
-				//DrawDebugString(_pWorld, pNode->GetPosition() + FVector::UpVector * _spacing_, tempTxt);
-				
-				if(pNode->_bConnectedNode)
-				{
-					FVector startTemp = pNode->GetPosition(); startTemp.Z = pNode->_fHeight;
-					DrawDebugDirectionalArrow(_pWorld, startTemp + pNode->_VNormal, cNode->GetPosition() + cNode->_VNormal, 60.0f, FColor::Yellow, true);
-				}
-			}
-		}
-	}
+	return GetDebugShapes(objectID, CDC_MissedRays);
 }
 
-inline void CoverGen::MargeNodesInProximity(CoverObject*& coverObject, float radius, bool margeOnlyNodesWithTheSameNormal)
+void CoverGen::UpdateDebugDraw()
 {
-#ifdef DebugMode
-	DebugCheckForDuplicates(coverObject);
-#endif // DebugMode
+	const uint32 mask = GetDebugDrawMask();
 
-	TArray<CoverNode*> TestedNodes;
-	TArray<CoverNode*> DuplicateNodes;
-
-	for(int indexCurrentNode = 0; indexCurrentNode < coverObject->GetAllCoverNodes().Num(); ++indexCurrentNode)
+	//everything was switched off, the buffer is emptied once
+	if (mask == 0)
 	{
-		CoverNode* cNodeCurrent = coverObject->GetAllCoverNodes()[indexCurrentNode];
-
-		if(!DuplicateNodes.Contains(cNodeCurrent))
-		{
-			for(int indexTestedNode = indexCurrentNode + 1; indexTestedNode < coverObject->GetAllCoverNodes().Num(); ++indexTestedNode)
-			{
-				CoverNode* cNodeTested  = coverObject->GetAllCoverNodes()[indexTestedNode];
-
-				if(!DuplicateNodes.Contains(cNodeTested))
-				{
-					float fDistance = FVector::Distance(cNodeCurrent->GetPosition(), cNodeTested->GetPosition());
-					if( fDistance <= radius )
-					{
-						if(margeOnlyNodesWithTheSameNormal)
-						{
-							if(FVector::DotProduct(cNodeCurrent->GetNormal(), cNodeTested->GetNormal()) > 0.8f)
-								DuplicateNodes.Add(cNodeTested);
-						}
-
-						else
-						{
-							DuplicateNodes.Add(cNodeTested);
-						}
-					}
-				}
-			}
+		if (_debugDrawMask != 0 && _debugDraw)
+			_debugDraw->Flush();
 
-			TestedNodes.Add(cNodeCurrent);
-		}
+		_debugDrawMask = 0;
+		return;
 	}
 
-	coverObject->CopyCoverNodes(TestedNodes);
-
-	for (auto node : DuplicateNodes)
-		delete node;
-}
-
-inline void CoverGen::MargeNodesInProximity2D(CoverObject*& coverObject, float radius)
-{
-#ifdef DebugMode
-	DebugCheckForDuplicates(coverObject);
-#endif // DebugMode
+	if (!_pWorld || _pWorld->ViewLocationsRenderedLastFrame.Num() == 0)
+		return;
 
+	const FVector vViewOrigin = _pWorld->ViewLocationsRenderedLastFrame[0];
+	const float drawDistance = FMath::Max(CVarCoverDebugDrawDistance.GetValueOnGameThread(), 0.0f);
+	const float drawDistanceSquared = drawDistance * drawDistance;
+	const float rebuildDistance = drawDistance * 0.1f; //how far the camera can move before the buffer is culled again
 
-	TArray<CoverNode*> TestedNodes;
-	TArray<CoverNode*> DuplicateNodes;
+	if (!_bDebugDrawDirty && mask == _debugDrawMask && drawDistance == _fDebugDrawDistance && FVector::DistSquared(vViewOrigin, _vDebugDrawOrigin) < rebuildDistance * rebuildDistance)
+		return;
 
-	for (int indexCurrentNode = 0; indexCurrentNode < coverObject->GetAllCoverNodes().Num(); ++indexCurrentNode)
+	if (!_debugDraw)
 	{
-		CoverNode* cNodeCurrent  = coverObject->GetAllCoverNodes()[indexCurrentNode];
-		FVector2D currentNodePos = { cNodeCurrent->GetPosition().X, cNodeCurrent->GetPosition().Y };
-
-		if (!DuplicateNodes.Contains(cNodeCurrent))
-		{
-			for (int indexTestedNode = indexCurrentNode + 1; indexTestedNode < coverObject->GetAllCoverNodes().Num(); ++indexTestedNode)
-			{
-				CoverNode* cNodeTested  = coverObject->GetAllCoverNodes()[indexTestedNode];
-				FVector2D testedNodePos = { cNodeTested->GetPosition().X, cNodeTested->GetPosition().Y };
-
-				if (!DuplicateNodes.Contains(cNodeTested) && floor(cNodeCurrent->GetPosition().Z) == floor(cNodeTested->GetPosition().Z))
-				{
-					float fDistance = FVector2D::Distance(currentNodePos, testedNodePos);
-					if (fDistance <= radius)
-					{
-						DuplicateNodes.Add(cNodeTested);
-					}
-				}
-			}
-
-			TestedNodes.Add(cNodeCurrent);
-		}
+		//CoverGen isn't a UObject so we have to keep the component alive ourselves
+		_debugDraw = NewObject<ULineBatchComponent>();
+		_debugDraw->AddToRoot();
+		_debugDraw->RegisterComponentWithWorld(_pWorld);
 	}
 
-	coverObject->CopyCoverNodes(TestedNodes);
+	_debugDrawMask = mask;
+	_fDebugDrawDistance = drawDistance;
+	_vDebugDrawOrigin = vViewOrigin;
+	_bDebugDrawDirty = false;
 
-	for (auto node : DuplicateNodes)
-		delete node;
-}
+	//shapes of the current cover, recorded shapes are added to the batch straight from _debugShapes
+	CoverDebugShapes shapes;
 
-inline void CoverGen::DebugDrawAllCoverNodes()
-{
-	if(allCoverObjects)
+	if (mask & ((1 << CDC_Nodes) | (1 << CDC_Links)))
 	{
-		// Dynamic nodes
-		for(auto dynamicCoverObject : allCoverObjects->DynamicCoverObjects)
-		{
-			//if(FVector::Distance((_pWorld->GetFirstPlayerController()->GetActorLocation()), dynamicCoverObject->GetLocation()) < 1000.0f)
-			{
-				int index = 0;
-				for(auto dynamicCoverNode : dynamicCoverObject->GetAllCoverNodes())
-				{
-					//Draw Node
-					DrawDebugSphere(_pWorld, dynamicCoverNode->GetPosition(), 2.5f, 5, FColor::Green, true);
-					//Draw normal
-					DrawDebugDirectionalArrow  (_pWorld, dynamicCoverNode->GetPosition(), dynamicCoverNode->GetPosition() + dynamicCoverNode->GetNormal() * 10.0f, 5.0f, FColor::Yellow, true);
-					//Draw height
-					FVector HeightVec = FVector(dynamicCoverNode->GetPosition().X, dynamicCoverNode->GetPosition().Y, dynamicCoverNode->GetPosition().Z + dynamicCoverNode->GetHeight());
-					DrawDebugLine(_pWorld, dynamicCoverNode->GetPosition() + dynamicCoverNode->GetNormal() * 2.0f, HeightVec, FColor::Green, true);
-					DrawDebugSphere(_pWorld, HeightVec, 2.5f, 2, FColor::Green, true);
-
-					/*
-					if(index != 0 && dynamicCoverObject->GetAllCoverNodes()[index - 1]->_bConnectedNode )
-					{
-						CoverNode* PrevNode    = dynamicCoverObject->GetAllCoverNodes()[index - 1];
-						CoverNode* tallerNode  = dynamicCoverNode->_fHeight < PrevNode->_fHeight ? PrevNode : dynamicCoverNode;
-						CoverNode* shorterNode = dynamicCoverNode == tallerNode ? PrevNode : dynamicCoverNode;
-						
-						for(float heightOffeset = 0.0f; heightOffeset <= tallerNode->_fHeight; heightOffeset += 0.1f)
-						{
-							FVector startPos = tallerNode->GetPosition(); startPos.Z = tallerNode->GetPosition().Z  + heightOffeset;
-							FVector endPos   = shorterNode->GetPosition();
+		for (CoverObject* dynamicCoverObject : allCoverObjects->DynamicCoverObjects)
+			AddNodeDebugShapes(dynamicCoverObject, mask, vViewOrigin, drawDistance, FColor::Green, shapes);
 
-							if (heightOffeset > shorterNode->_fHeight)
-								endPos.Z = shorterNode->GetPosition().Z + shorterNode->_fHeight;
+		for (CoverObject* staticCoverObject : allCoverObjects->StaticCoverObjects)
+			AddNodeDebugShapes(staticCoverObject, mask, vViewOrigin, drawDistance, FColor::Blue, shapes);
+	}
 
-							else
-								endPos.Z = shorterNode->GetPosition().Z + heightOffeset;
+	if (mask & (1 << CDC_Occupancy))
+		for (const CoverOccupancyBox& occupancyBox : _occupancyBoxes)
+			if (occupancyBox.bActive && FVector::DistSquared(occupancyBox.vCenter, vViewOrigin) < drawDistanceSquared)
+				shapes.AddBox(CDC_Occupancy, occupancyBox.vCenter, occupancyBox.vExtent, occupancyBox.qRotation, FColor::Purple);
 
-							startPos += tallerNode->_VNormal  * 10.0f;
-							endPos   += shorterNode->_VNormal * 10.0f;
+	_debugDraw->Flush();
+	TArray<FBatchedLine> batchedLines;
+	batchedLines.Reserve(shapes.lines.Num());
 
-							DrawDebugLine(_pWorld, startPos, endPos, FColor::Green, true);
-						}
+	auto batchShapes = [&](const CoverDebugShapes& source)
+	{
+		for (const CoverDebugLine& line : source.lines)
+			if ((mask & (1 << line.category)) && FVector::DistSquared(line.vStart, vViewOrigin) < drawDistanceSquared)
+				batchedLines.Add(FBatchedLine(line.vStart, line.vEnd, line.color, 0.0f, 0.0f, SDPG_World));
 
-					
-					}
+		for (const CoverDebugPoint& point : source.points)
+			if ((mask & (1 << point.category)) && FVector::DistSquared(point.vPosition, vViewOrigin) < drawDistanceSquared)
+				_debugDraw->BatchedPoints.Add(FBatchedPoint(point.vPosition, point.color, point.fSize, 0.0f, SDPG_World));
+	};
 
-					index++;
-					*/
-				}
-			}
-		}
+	batchShapes(shapes);
 
+	for (const TPair<int32, CoverDebugShapes>& shapesPair : _debugShapes)
+		batchShapes(shapesPair.Value);
 
-		// Static nodes
-		for (auto staticCoverObject : allCoverObjects->StaticCoverObjects)
-		{
-			int index = 0;
-			for (auto staticCoverNode : staticCoverObject->GetAllCoverNodes())
-			{
-				//Draw Node
-				DrawDebugSphere(_pWorld, staticCoverNode->GetPosition(), 2.5f, 5, FColor::Blue, true);
-				//Draw normal
-				DrawDebugDirectionalArrow  (_pWorld, staticCoverNode->GetPosition(), staticCoverNode->GetPosition() + staticCoverNode->GetNormal() * 10.0f, 5.0f, FColor::Yellow, true);
-				//Draw height
-				FVector HeightVec = FVector(staticCoverNode->GetPosition().X, staticCoverNode->GetPosition().Y, staticCoverNode->GetPosition().Z + staticCoverNode->GetHeight());
-				DrawDebugLine(_pWorld, staticCoverNode->GetPosition() + staticCoverNode->GetNormal() * 2.0f, HeightVec, FColor::Blue, true);
-				DrawDebugSphere(_pWorld, HeightVec, 2.5f, 2, FColor::Blue, true);
-				//DrawDebugString(_pWorld, staticCoverNode->GetPosition(), HeightVec.ToString());
-				index++;
-			}
-		}
-	}
+	//lifetime 0 - everything stays until the next rebuild flushes it
+	_debugDraw->DrawLines(batchedLines);
 }
 
-inline void CoverGen::FindEdgeLink(int& currentIndex, TArray<FVector>& vertices, TArray<CoverGen::Edge2*>& edgesOut, FVector& V0, FVector& V1, FVector& V2, FVector triangleNormal, bool ignoreSurfacesWithVerticalFaces)
+void CoverGen::AddNodeDebugShapes(CoverObject* coverObject, uint32 mask, const FVector& vViewOrigin, float drawDistance, const FColor& nodeColor, CoverDebugShapes& outShapes) const
 {
-	if (vertices[currentIndex] == V0)
-	{
-		for (int vertIndex2 = currentIndex + 1; vertIndex2 < vertices.Num(); ++vertIndex2)
-		{
-			if (vertices[vertIndex2] == V1)
-			{
-				if((triangleNormal.Z < 0.8f && triangleNormal.Z > -0.8f) || !ignoreSurfacesWithVerticalFaces)
-				{
-					FVector linkDirection = V1 - V0;
-					linkDirection.Normalize();
-
-					if((linkDirection.Z < 0.8f && linkDirection.Z > -0.8f) || !ignoreSurfacesWithVerticalFaces)
-					{
-						Edge2* tempEdge = new Edge2(V0, V1, triangleNormal, linkDirection);
-						edgesOut.Add(tempEdge);
-					}
-				}
-				break;
-			}
+	const bool bNodes = (mask & (1 << CDC_Nodes)) != 0;
+	const bool bLinks = (mask & (1 << CDC_Links)) != 0;
+	const float drawDistanceSquared = drawDistance * drawDistance;
+	const CoverNodeStore& nodes = coverObject->GetNodes();
 
-			if (vertices[vertIndex2] == V2)
-			{
-				if ((triangleNormal.Z < 0.8f && triangleNormal.Z > -0.8f) || !ignoreSurfacesWithVerticalFaces)
-				{
-					FVector linkDirection = V2 - V0;
-					linkDirection.Normalize();
+	for (CoverNodeHandle node = 0; node < nodes.Num(); ++node)
+	{
+		const FVector position = nodes.GetPosition(node);
+		if (FVector::DistSquared(position, vViewOrigin) >= drawDistanceSquared)
+			continue;
 
-					if ((linkDirection.Z < 0.8f && linkDirection.Z > -0.8f) || !ignoreSurfacesWithVerticalFaces)
-					{
-						Edge2* tempEdge = new Edge2(V0, V2, triangleNormal, linkDirection);
-						edgesOut.Add(tempEdge);
-					}
-				}
-				break;
-			}
-		}
-	}
-}
+		const FVector normal = nodes.GetNormal(node);
+		const FVector HeightVec = FVector(position.X, position.Y, position.Z + nodes.GetHeight(node));
 
-inline void CoverGen::CreateEdgeLinks(const TArray<FVector>& triangles, TArray<FVector>& vertices, TArray<CoverGen::Edge2*>& edgesOut)
-{
-	for(int vertIndex1 = 0; vertIndex1 < vertices.Num() - 1; ++vertIndex1)
-	{
-		for(int V = 2; V < triangles.Num(); V += 3)
+		if (bNodes)
 		{
-			//Single Triangle
-			FVector V0 = triangles[V - 0];
-			FVector V1 = triangles[V - 1];
-			FVector V2 = triangles[V - 2];
-			FVector vNormal = CalculateSurfaceNormalOfATriangle(V0, V1, V2);
-			vNormal.Normalize();
-
-			// If V0 is our vertex point
-			if (vertices[vertIndex1] == V0)
-				FindEdgeLink(vertIndex1, vertices, edgesOut, V0, V1, V2, vNormal, true);
-
-			// If V1 is our vertex point
-			else if (vertices[vertIndex1] == V1)
-				FindEdgeLink(vertIndex1, vertices, edgesOut, V1, V0, V2, vNormal, true);
-
-			// If V2 is our vertex point
-			else if (vertices[vertIndex1] == V2)
-				FindEdgeLink(vertIndex1, vertices, edgesOut, V2, V0, V1, vNormal, true);
+			//Draw Node
+			outShapes.AddPoint(CDC_Nodes, position, 5.0f, nodeColor);
+			//Draw normal
+			outShapes.AddArrow(CDC_Nodes, position, position + normal * 10.0f, 5.0f, FColor::Yellow);
+			//Draw height
+			outShapes.AddLine(CDC_Nodes, position + normal * 2.0f, HeightVec, nodeColor);
+			outShapes.AddPoint(CDC_Nodes, HeightVec, 5.0f, nodeColor);
 		}
-	}
-}
-
-inline bool CoverGen::isVecHeightInBounds(const float& boundingBoxBottom, FVector& vec, float min, float max)
-{
-	if (boundingBoxBottom + min > vec.Z)
-		return false;
-
-	if (boundingBoxBottom + max < vec.Z)
-		return false;
-
-	return true;
-}
-
-CoverGen::CoverNode* CoverGen::CoverObject::AddNewCoverPoint(FVector nodePosition, FVector nodeNormal)
-{
-	CoverNode* tempNode = new CoverNode(_coverNodes.Num(), nodePosition, nodeNormal);
-	//  use size of the array (_coverNodes.Num()) to pass the index
-	_coverNodes.Add(tempNode);
 
-	return tempNode;
-}
-
-void CoverGen::CoverObject::CopyCoverNodes(TArray<CoverNode*>& copyFrom)
-{
-	_coverNodes.Empty();
-	int index = 0;
-	
-	for (auto node : copyFrom)
-	{
-		_coverNodes.Add(node);
-		node->_iIndex = index;
-		index++;
+		//from the top of the node to the next node of its chain
+		if (bLinks && node + 1 < nodes.Num() && nodes.HasFlag(node, CNF_ConnectedNode))
+			outShapes.AddArrow(CDC_Links, HeightVec + normal, nodes.GetPosition(node + 1) + nodes.GetNormal(node + 1), 60.0f, FColor::Yellow);
 	}
 }
 
-TArray<CoverGen::CoverNode*> CoverGen::CoverObject::GetTheLowestChainOfNodes(float spacing)
+TArray<CoverGen::CoverNodeHandle> CoverGen::CoverObject::GetTheLowestChainOfNodes(float spacing)
 {
-	TArray<CoverNode*> result;
+	TArray<CoverNodeHandle> result;
 	TArray<FVector2D> AllXY;
-
 	//get all unique X and Y position in the array
-	for(auto node : _coverNodes)
+	for(CoverNodeHandle node = 0; node < _nodes.Num(); ++node)
 	{
+		const FVector position = _nodes.GetPosition(node);
 		bool matchFound = false;
 		for(auto pos2D : AllXY)
-			if (FVector2D::Distance(pos2D, FVector2D(node->GetPosition().X, node->GetPosition().Y)) < spacing - 1.0f)
+			if (FVector2D::Distance(pos2D, FVector2D(position.X, position.Y)) < spacing - 1.0f)
 			{
 				matchFound = true;
 				break;
@@ -1368,15 +2909,15 @@ TArray<CoverGen::CoverNode*> CoverGen::CoverObject::GetTheLowestChainOfNodes(flo
 
 		if (!matchFound)
 		{
-			AllXY.Add(FVector2D(node->GetPosition().X, node->GetPosition().Y));
+			AllXY.Add(FVector2D(position.X, position.Y));
 			matchFound = false;
 		}
 	}
 
 	//get lowest nodes on each X & Y (because we start ray cast from the bottom the first node in the array is guaranteed to be the lowest)
 	for(FVector2D pos : AllXY)
-		for (auto node : _coverNodes)
-			if (FVector2D::Distance(pos, FVector2D(node->GetPosition().X, node->GetPosition().Y)) < spacing / 2.0f)
+		for (CoverNodeHandle node = 0; node < _nodes.Num(); ++node)
+			if (FVector2D::Distance(pos, FVector2D(_nodes.GetPosition(node))) < spacing / 2.0f)
 			{
 				result.Add(node);
 				break;
@@ -1386,56 +2927,94 @@ TArray<CoverGen::CoverNode*> CoverGen::CoverObject::GetTheLowestChainOfNodes(flo
 	return result;
 }
 
-void CoverGen::CoverObject::OrganizeNodeArrayByLocation()
+int32 CoverGen::CoverNodeStore::FindSegment(int32 slot) const
 {
-	//Find unique normals
-	TArray<FVector> arrayOfUniqueNormals;
-	for (CoverNode* node : _coverNodes)
-	{
-		if(!(arrayOfUniqueNormals.Contains(node->_VNormal)))
-		{
-			arrayOfUniqueNormals.Add(node->_VNormal);
-		}
-	}
+	//segments are sorted by their first slot
+	const int32 segment = Algo::UpperBoundBy(_segmentView, slot, [](const CoverCore::CoverSegment& S) { return S.firstSlot; }) - 1;
+
+	if (segment < 0 || slot >= _segmentView[segment].firstSlot + _segmentView[segment].slotCount)
+		return INDEX_NONE;
+
+	return segment;
+}
+
+bool CoverGen::CoverNodeStore::GetSlot(int32 slot, FVector& outPosition, FVector& outNormal, float& outHeight) const
+{
+	const int32 segmentIndex = FindSegment(slot);
+
+	if (segmentIndex == INDEX_NONE)
+		return false;
+
+	const CoverCore::CoverSegment& segment = _segmentView[segmentIndex];
+	const CoverNodeHandle lastNode = segment.firstNode + segment.nodeCount - 1;
+	float distance = (slot - segment.firstSlot) * segment.GetSlotStep();
 
-	TArray<CoverNode*> organizedCoverNodes;
-	for(FVector uniqueNormal : arrayOfUniqueNormals)
+	outPosition = GetPosition(segment.firstNode);
+	outHeight   = GetHeight(segment.firstNode);
+	outNormal   = FVector(segment.vNormal.X, segment.vNormal.Y, segment.vNormal.Z);
+
+	//walk the polyline up to the edge the slot is on, the last edge takes whatever is left
+	for (CoverNodeHandle node = segment.firstNode; node < lastNode; ++node)
 	{
-		for(CoverNode* node : _coverNodes)
+		const FVector vEnd = GetPosition(node + 1);
+		const float edgeLength = FVector::Dist(outPosition, vEnd);
+
+		if (distance <= edgeLength || node + 1 == lastNode)
 		{
-			if (uniqueNormal == node->_VNormal)
-			{
-				node->_iIndex = organizedCoverNodes.Num();
-				organizedCoverNodes.Add(node);
-			}
+			const float alpha = edgeLength > KINDA_SMALL_NUMBER ? FMath::Clamp(distance / edgeLength, 0.0f, 1.0f) : 0.0f;
+			outPosition = FMath::Lerp(outPosition, vEnd, alpha);
+			outHeight   = FMath::Lerp(GetHeight(node), GetHeight(node + 1), alpha);
+			break;
 		}
+
+		distance -= edgeLength;
+		outPosition = vEnd;
 	}
 
-	CopyCoverNodes(organizedCoverNodes);
+	return true;
+}
+
+void CoverGen::CoverNodeStore::Assign(const CoverCore::NodeArrays& nodes, const std::vector<CoverCore::CoverSegment>& segments, const FVector& vOrigin)
+{
+	_frame = CoverCore::MakePackedNodeFrame(nodes, ToCoreVector(vOrigin));
+	_packedNodes.Empty(nodes.Num());
+
+	for (CoverCore::NodeHandle node = 0; node < nodes.Num(); ++node)
+		_packedNodes.Add(CoverCore::PackNode(_frame, nodes.positions[node], nodes.normals[node], nodes.heights[node], nodes.flags[node]));
 
-	//for(int mainNodeIndex = 0; mainNodeIndex < _coverNodes.Num() - 1; ++mainNodeIndex)
-	//	for(int testedNodeIndex = mainNodeIndex + 1; testedNodeIndex < _coverNodes.Num(); ++testedNodeIndex)
-	//		if(_coverNodes[mainNodeIndex]->GetNormal() == _coverNodes[testedNodeIndex]->GetNormal())
-	//		{
-	//			_coverNodes[mainNodeIndex]->_iIndex = testedNodeIndex;
-	//			_coverNodes[testedNodeIndex]->_iIndex = mainNodeIndex;
-	//			_coverNodes.Swap(mainNodeIndex, testedNodeIndex);
-	//		}
+	_segments.Empty((int32)segments.size());
+	_segments.Append(segments.data(), (int32)segments.size());
+	_nodeView = _packedNodes;
+	_segmentView = _segments;
+	_occupancyBoxes.Init(INDEX_NONE, nodes.Num());
 }
 
-void CoverGen::CoverObject::RemoveCoverNodes(TArray<CoverNode*>& nodesToBeRemoved)
+void CoverGen::CoverNodeStore::Assign(const CoverCore::PackedNodeFrame& frame, const CoverCore::PackedNode* packedNodes, int32 count, const CoverCore::CoverSegment* segments, int32 segmentCount)
 {
-	TArray<CoverNode*> newNodeArray;
+	_frame = frame;
+	_packedNodes.Empty();
+	_segments.Empty();
+	_nodeView = TArrayView<const CoverCore::PackedNode>(packedNodes, count);
+	_segmentView = TArrayView<const CoverCore::CoverSegment>(segments, segmentCount);
+	_occupancyBoxes.Init(INDEX_NONE, count);
+}
 
-	for(auto node : _coverNodes)
-	{
-		if (!nodesToBeRemoved.Contains(node))
-			newNodeArray.Add(node);
-	}
+void CoverGen::CoverNodeStore::Empty()
+{
+	_packedNodes.Empty();
+	_segments.Empty();
+	_nodeView = TArrayView<const CoverCore::PackedNode>();
+	_segmentView = TArrayView<const CoverCore::CoverSegment>();
+	_occupancyBoxes.Empty();
+	_frame = CoverCore::PackedNodeFrame();
+}
 
-	for (auto nodeDelete : nodesToBeRemoved)
-		delete nodeDelete;
+SIZE_T CoverGen::CoverNodeStore::GetAllocatedSize() const
+{
+	return _packedNodes.GetAllocatedSize() + _segments.GetAllocatedSize() + _occupancyBoxes.GetAllocatedSize();
+}
 
-	_coverNodes.Empty();
-	_coverNodes = newNodeArray;
+SIZE_T CoverGen::CoverObject::GetAllocatedSize() const
+{
+	return sizeof(CoverObject) + _nodes.GetAllocatedSize() + _Name.GetAllocatedSize();
 }
@@ -5,18 +5,112 @@
 #include "CoreMinimal.h"
 #include "Engine/World.h"
 #include "Containers/Array.h"
-#include "CoverTriggerBox.h"
+#include "Tickable.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Components/SceneComponent.h"
+#include "CoverCore.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+class UCoverActorListener;
+class APawn;
+class ULineBatchComponent;
+class FAutoConsoleVariableSink;
+
+//options used by CoverGen when generating cover
+struct CoverGenSettings
+{
+	bool  bBatchedTraces  = false; //submit column rays as async trace batches and resolve them on later frames instead of tracing them one by one
+	int32 maxRaysPerBatch = 4096;  //how many async rays can be submitted in a single frame
+	bool  bParallelGeneration = false; //trace and post-process each object on the task graph instead of one after another
+	float frameBudgetMs = 0.0f;        //how long generation can run each tick, 0 - generate everything when CoverGen is created
+	bool  bLoadBakedCover = false;     //use the level's baked cover file if there is one instead of generating cover
+	bool  bBakeCover = false;          //write the level's baked cover file once generation finishes
+	bool  bIncrementalUpdates = false; //regenerate cover of actors that were spawned, destroyed or moved after generation
+	float dirtySettleTime = 0.25f;     //how long (in seconds) a moved actor has to stay still before its cover is regenerated
+	bool  bAnalyticBoxCover = false;       //place nodes of single box actors straight from their bounding box instead of tracing every height
+	bool  bAnalyticOcclusionTraces = true; //trace the lowest ray of analytic columns to drop faces blocked by neighbouring actors
+	bool  bBisectHeights = false;          //find the top of each column by bisection instead of tracing every height step (synchronous traces only)
+	bool  bLocalGeometryTraces = false;    //trace CoverFromGeometry actors against a BVH of their own triangles instead of the physics scene
+	bool  bFollowLevelStreaming = false;   //generate cover for every visible level and free it once the level is streamed out (persistent level only otherwise)
+	float segmentMinNormalDot = 0.95f;     //a cover segment ends where the next node faces further than this from its normal so far (0.95 - about 18 degrees)
+	float slotSpacing = 100.0f;            //distance between the spots (slots) of a cover segment, about one agent wide
+	float queryCellSize = 1000.0f;         //cell size of the level-wide grid used by cover queries
+	int32 maxCoverClaims = 4096;           //initial size of the claim table (rounded up to a power of two), expired claims are dropped once half of it is used and it grows while live claims need the room
+	FString statsCsvPath;                  //a row of generation stats is appended here for every finished object, empty - no CSV
+};
+
+//a single cover spot, stays valid until cover of its object is regenerated or its level is streamed out (the object gets a new ID then, so old refs and claims don't resolve)
+//node is one of the object's slots, the spots spread evenly along its cover segments (about slotSpacing apart)
+struct CoverNodeRef
+{
+	int32 objectID = -1;
+	int32 node     = -1;
+
+	inline bool IsValid() const { return objectID >= 0 && node >= 0; }
+};
+
+//best maxResults cover nodes within fRadius of vOrigin that are at least fMinHeight tall (and face away from vThreat)
+struct CoverQuery
+{
+	FVector vOrigin    = FVector::ZeroVector;
+	float   fRadius    = 1000.0f;
+	float   fMinHeight = 0.0f;
+	int32   maxResults = 8;
+	bool    bHasThreat = false;
+	FVector vThreat    = FVector::ZeroVector;
+	float   fMinThreatDot = 0.5f; //how far behind the cover the threat has to be, 1 - straight behind it, 0 - anywhere on the far side
+	uint32  claimantID = 0;        //nodes claimed by anyone else are skipped, 0 - claims are ignored
+	float   fClaimDuration = 0.0f; //claim the best node for this long (seconds), it's the first result if the claim succeeded
+};
+
+//pawn entered or left the occupancy box of a cover node
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnCoverOccupancyChanged, APawn* /*pawn*/, const CoverNodeRef& /*nodeRef*/);
+
 /**
  * 
  */
-class COVERSYSTEM_API CoverGen
+class COVERSYSTEM_API CoverGen : public FTickableGameObject
 {
+	friend UCoverActorListener;
+
 public:
-	CoverGen(UWorld* worldPtr);
+	CoverGen(UWorld* worldPtr, const CoverGenSettings& settings = CoverGenSettings());
 	~CoverGen();
 
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override { return !IsGenerationFinished() || _pendingWork.Num() > 0 || _dirtyActors.Num() > 0 || _queuedQueries.queries.Num() > 0 || _runningQueryBatch || _numOccupancyBoxes > 0 || IsDebugDrawActive(); }
+	virtual UWorld* GetTickableGameObjectWorld() const override { return _pWorld; }
+	virtual TStatId GetStatId() const override { RETURN_QUICK_DECLARE_CYCLE_STAT(CoverGen, STATGROUP_Tickables); }
+	// End of FTickableGameObject interface
+
+	inline bool IsGenerationFinished() const { return _actorsFinished >= _actorsToPrepare.Num(); } //regenerated actors can still be pending
+	float GetGenerationProgress() const; //0 - 1, share of the level's actors that were already processed
+
+	//Baked cover
+	static FString GetBakedCoverPath(ULevel* level);
+	bool SaveBakedCover(ULevel* level, const FString& filePath) const;
+
+	//Cover queries (game thread)
+	typedef TFunction<void(const TArray<CoverNodeRef>& nodes)> CoverQueryCallback;
+
+	int32 QueryCover(const CoverQuery& query, TArray<CoverNodeRef>& outNodes); //best nodes first, returns how many were found
+	void QueueCoverQuery(const CoverQuery& query, CoverQueryCallback onFinished); //resolved on worker threads together with the other queries of this frame, onFinished is called on the next tick
+	bool GetCoverNode(const CoverNodeRef& nodeRef, FVector& outPosition, FVector& outNormal, float& outHeight);
+
+	//Cover claims (lock-free, worker threads can claim as long as CoverGen isn't ticking at the same time), claimantID can't be 0
+	bool ClaimCover(const CoverNodeRef& nodeRef, uint32 claimantID, float durationSeconds); //fails if someone else holds an unexpired claim, the claimant can extend its own
+	void ReleaseCover(const CoverNodeRef& nodeRef, uint32 claimantID);
+	bool IsCoverClaimed(const CoverNodeRef& nodeRef, uint32 ignoredClaimantID = 0) const;
+
+	//Cover occupancy, raised on the game thread once per tick
+	FOnCoverOccupancyChanged OnCoverEntered;
+	FOnCoverOccupancyChanged OnCoverExited;
+
 private:
 	UWorld* _pWorld = nullptr;
+	CoverGenSettings _settings;
 
 	struct CoverActors
 	{
@@ -24,59 +118,73 @@ private:
 		TArray<AActor*> StaticActors;
 	};
 
-	class CoverNode
+	//index of a node in its CoverObject's node store, stays valid until nodes of the object are removed or reordered (post-processing, regeneration)
+	typedef int32 CoverNodeHandle;
+
+	enum ECoverNodeFlags : uint8
 	{
+		CNF_None          = 0,
+		CNF_ConnectedNode = CoverCore::NF_ConnectedNode, // Node has connection to the next node of its cover segment
+		CNF_MainNode      = CoverCore::NF_MainNode,      //if the node is the first node we start optimization from (we can have multiple main nodes if there are holes in geometry), or a corner shared by two segments
+	};
 
+	//nodes of a single CoverObject, packed to 10 bytes each (CoverCore::PackedNode) around the object's location and decoded on access
+	//consecutive nodes form cover segments, queries and occupancy work on the segments' slots instead of the nodes
+	//baked objects read their nodes and segments in place from the level's mapped cover file, generated ones own them
+	class CoverNodeStore
+	{
 	friend CoverGen;
 
 	public:
-		CoverNode(int32 index, FVector position, FVector normal) : _iIndex(index), _VPosition(position), _VNormal(normal), _fHeight(position.Z) {};
-		~CoverNode() {}
+		inline int32   Num()                             const { return _nodeView.Num(); }
+		inline int32   NumSegments()                     const { return _segmentView.Num(); }
+		inline int32   NumSlots()                        const { return _segmentView.Num() > 0 ? _segmentView.Last().firstSlot + _segmentView.Last().slotCount : 0; }
+		inline const CoverCore::CoverSegment& GetSegment(int32 segment) const { return _segmentView[segment]; }
+		int32 FindSegment(int32 slot) const; //INDEX_NONE if the slot isn't in any segment
+		bool  GetSlot(int32 slot, FVector& outPosition, FVector& outNormal, float& outHeight) const;
+		inline FVector GetPosition(CoverNodeHandle node) const { const CoverCore::Vector position = CoverCore::UnpackPosition(_frame, _nodeView[node]); return FVector(position.X, position.Y, position.Z); }
+		inline FVector GetNormal(CoverNodeHandle node)   const { const CoverCore::Vector normal = CoverCore::UnpackNormal(_nodeView[node]); return FVector(normal.X, normal.Y, normal.Z); }
+		inline float   GetHeight(CoverNodeHandle node)   const { return CoverCore::UnpackHeight(_frame, _nodeView[node]); } //height above the node
+		inline bool    HasFlag(CoverNodeHandle node, ECoverNodeFlags flag) const { return (CoverCore::UnpackFlags(_nodeView[node]) & flag) != 0; }
+		SIZE_T GetAllocatedSize() const; //baked nodes and segments aren't counted, they are in the mapped file
 
 	private:
-		int32	_iIndex    = -1;
-		FVector _VPosition = { 0.0f, 0.0f ,0.0f };
-		FVector _VNormal   = { 0.0f, 0.0f ,0.0f };
-		float   _fHeight    = 0.0f;
-		bool _bConnectedNode = false; // Node has connection to another node
-		bool _bMainNode = false; //if the node is the first node we start optimization from (we can have multiple main nodes if there are holes in geometry)
-		ACoverTriggerBox* _triggerBox = nullptr;
+		void Assign(const CoverCore::NodeArrays& nodes, const std::vector<CoverCore::CoverSegment>& segments, const FVector& vOrigin); //nodes of a finished object, copied into the store
+		void Assign(const CoverCore::PackedNodeFrame& frame, const CoverCore::PackedNode* packedNodes, int32 count, const CoverCore::CoverSegment* segments, int32 segmentCount); //baked nodes, used in place (they have to outlive the store)
+		void Empty();
 
-	public:
-		inline FVector GetPosition() const { return _VPosition; }
-		inline FVector GetNormal()   const { return _VNormal;   }
-		inline float   GetHeight()   const { return _fHeight;   }
+		TArray<CoverCore::PackedNode> _packedNodes;    //owned nodes, empty for baked objects
+		TArray<CoverCore::CoverSegment> _segments;
+		TArrayView<const CoverCore::PackedNode> _nodeView;      //_packedNodes or the object's nodes in the mapped file, moving the store keeps it valid (TArray moves its allocation)
+		TArrayView<const CoverCore::CoverSegment> _segmentView; //_segments or the object's segments in the mapped file
+		CoverCore::PackedNodeFrame    _frame;          //origin and fixed point step shared by all nodes
+		TArray<int32>                 _occupancyBoxes; //index into CoverGen::_occupancyBoxes, -1 - no occupancy box (owned by baked objects too)
 	};
 
-
 	class CoverObject
 	{
 	friend CoverGen;
 
 	public:
 		 CoverObject() {}
-		~CoverObject() {}
 
 	private:
 		int32 _ID = -1;
 		FString _Name = "Unknown";
-		TArray<CoverNode*> _coverNodes;
+		CoverNodeStore _nodes;
 		FVector vLocation = { 0.0f, 0.0f, 0.0f };   //general location used to calculate a distance from another entity
 		FVector _vScale   = { 0.0f, 0.0f, 0.0f };   //general scale of the object
 
 	public:
 		inline const FVector GetLocation()           { return vLocation;   }
 		inline const FVector GetSize()               { return _vScale;       }
-		inline TArray<CoverNode*> GetAllCoverNodes() { return _coverNodes; }
+		inline const CoverNodeStore& GetNodes() const { return _nodes; }
 		inline FString GetName()                     { return _Name;       }
+		SIZE_T GetAllocatedSize() const;             //bytes used by the object's nodes and name
 	private:
 		inline void SetLocation(FVector Location)    { vLocation = Location; }
 		inline void SetSize(FVector Size)            { _vScale = Size; }
-		CoverNode* AddNewCoverPoint(FVector nodePosition, FVector nodeNormal);
-		void CopyCoverNodes(TArray<CoverNode*> &copyFrom);
-		void RemoveCoverNodes(TArray<CoverNode*>& nodesToBeRemoved);
-		TArray<CoverNode*> GetTheLowestChainOfNodes(float spacing);
-		void OrganizeNodeArrayByLocation();
+		TArray<CoverNodeHandle> GetTheLowestChainOfNodes(float spacing);
 	};
 
 	struct CoverObjects
@@ -91,54 +199,394 @@ protected:
 private:
 	CoverObjects* allCoverObjects = nullptr; //to store a list of static and dynamic cover objects
 
-	//used to store two connected vertices that can be later used for a line trace
-	struct Edge2
+	//columns, sweeps and ray results are CoverCore's, CoverGen only feeds them from the engine
+	typedef CoverCore::RayColumn   RayColumn;
+	typedef CoverCore::SweepParams SweepParams;
+	typedef CoverCore::RayHit      RayHit;
+
+	//Local geometry traces
+	struct GeometryTriangle
 	{
-		FVector vP1;
-		FVector vP2;
+		FVector vV0;
+		FVector vEdge1;  //V1 - V0
+		FVector vEdge2;  //V2 - V0
 		FVector vNormal;
-		FVector vDirection;
+	};
+
+	struct GeometryBVHNode
+	{
+		FBox  bounds = FBox(ForceInit);
+		int32 iFirst = 0; //first triangle of a leaf, or the first of two children of an inner node (the second one follows it)
+		int32 iCount = 0; //number of triangles in a leaf, 0 - inner node
+	};
+
+	//triangles of a single actor in world space, leaves hold at most GeometryLeafSize triangles
+	struct GeometryBVH
+	{
+		TArray<GeometryBVHNode>  nodes;
+		TArray<GeometryTriangle> triangles;
+	};
+
+	//cover of a single level, its objects are in allCoverObjects as well
+	struct LevelCover
+	{
+		TArray<CoverObject*> coverObjects;
+		FString bakedCoverPath;
+		bool bNeedsBake = false; //cover is being generated, write it to bakedCoverPath once generation finishes
+
+		//Baked cover, node stores of the level's baked objects point into it until the level is released
+		IMappedFileHandle* bakedFileHandle = nullptr;
+		IMappedFileRegion* bakedFileRegion = nullptr;
+		TArray<uint8>      bakedFileData; //used instead of the mapped region if the platform can't map files
+	};
+
+	//counters of a single object, or of everything generated since generation started (phases are CoverCore::GenerationPhase)
+	typedef CoverCore::GenerationStats CoverGenStats;
+
+	//everything needed to generate cover for a single actor, so its rays can be traced now or resolved on a later frame
+	struct CoverWorkItem
+	{
+		AActor* actor = nullptr;
+		uint32 actorUniqueID = 0;
+		CoverObject* coverObject = nullptr;
+		LevelCover* levelCover = nullptr; //level the actor belongs to (nullptr if the level doesn't have cover)
+		SweepParams sweep;
+		std::vector<RayColumn> columns;
+		CoverCore::NodeArrays nodes; //moved to coverObject once the object is finished
+		bool bFromGeometry  = false;
+		bool bOptimize      = true;
+		bool bOccupancyBoxes = false;
+		bool bAnalytic      = false; //nodes come from the bounding box faces, rays are only used to check for occlusion
+		bool bLocalTraces   = false; //columns are traced against geometry instead of the physics scene
+		SIZE_T edgeLinkBytes = 0;    //arena memory the object's edge links needed while its columns were built
+		GeometryBVH geometry;
+		CoverObject* replacedObject = nullptr; //existing object that gets coverObject's nodes once the work is done (incremental updates)
+		bool bIncremental   = false; //queued by UpdateDirtyActors, doesn't count towards the generation progress
+		CoverGenStats stats;
+
+		//batched traces
+		int32 nextColumnToSubmit = 0;           //columns before this index were submitted
+		int32 nextColumnToResolve = 0;          //columns before this index have already created their nodes
+		TArray<std::vector<CoverCore::Vector>> columnRayStarts;
+		TArray<std::vector<RayHit>> columnHits;
+		TArray<bool>            columnReady;    //all rays of the column came back
+	};
+
+	//async traces of a single column that are waiting for their results
+	struct PendingColumn
+	{
+		CoverWorkItem* work = nullptr;
+		int32 columnIndex = -1;
+		TArray<FTraceHandle> traceHandles;
+	};
+
+	//Cover queries
+	//a single edge of a cover segment's polyline (or a segment of a single node), with the slots that lie on it
+	struct CoverIndexEntry
+	{
+		FVector vStart;
+		FVector vEnd;
+		FVector vNormal;       //of the whole segment
+		float   fStartHeight;
+		float   fEndHeight;
+		float   fStartDistance; //along the segment
+		float   fEndDistance;
+		float   fSlotStep;     //distance between two slots of the segment
+		int32   objectID;
+		int32   segmentFirstSlot;
+		int32   firstSlot;     //slots of the segment that are on this edge, an edge shorter than the step can have none
+		int32   lastSlot;
+		FIntPoint minCell;     //entries are in every cell their bounds touch, a query only reads them in the first of those cells it searches
+	};
+
+	//edges of the finished cover segments of every level, every cell is a range of 'cellEntries'
+	//a new index is built every time cover changes, so queries on worker threads can keep reading the old one
+	struct CoverQueryIndex
+	{
+		float fCellSize = 1000.0f;
+		TArray<CoverIndexEntry> entries;
+		TArray<int32> cellEntries;                //entries sorted by cell, long edges are in several cells
+		TMap<FIntPoint, FIntPoint> cells;         //X - first of cellEntries, Y - entry count
+		TMap<int32, CoverObject*>  objectsByID;   //game thread only
+
+		inline FIntPoint GetCell(const FVector& position) const { return FIntPoint(FMath::FloorToInt(position.X / fCellSize), FMath::FloorToInt(position.Y / fCellSize)); }
+	};
+
+	//claims of cover nodes, open addressing over packed node refs with a CAS on every slot
+	//keys are never removed, the table is replaced by a compacted copy on the game thread once it fills up
+	class CoverClaimTable
+	{
+	public:
+		CoverClaimTable(int32 capacity, double timeOrigin);
 
-		Edge2(FVector Ponit1, FVector Point2, FVector Normal, FVector Direction) :
-			vP1(Ponit1),
-			vP2(Point2),
-			vNormal(Normal),
-			vDirection(Direction)
-		{;}
+		bool  Claim(const CoverNodeRef& nodeRef, uint32 claimantID, float durationSeconds);
+		void  Release(const CoverNodeRef& nodeRef, uint32 claimantID);
+		bool  IsClaimed(const CoverNodeRef& nodeRef, uint32 ignoredClaimantID) const;
+		int32 GetCapacity() const { return _keys.Num(); }
+		int32 GetNumKeys()  const { return FPlatformAtomics::AtomicRead(&_numKeys); }
+		int32 GetNumFailedClaims() const { return FPlatformAtomics::AtomicRead(&_numFailedClaims); } //claims that didn't fit into the table
+		int32 GetNumLiveClaims() const; //unexpired claims
+		void  CopyLiveClaims(CoverClaimTable& target) const;
+
+	private:
+		int32  FindSlot(uint64 key, bool bAdd); // INDEX_NONE - not in the table (or the table is full)
+		int32  FindSlot(uint64 key) const;
+		uint32 GetTimeMs() const { return (uint32)((FPlatformTime::Seconds() - _timeOrigin) * 1000.0); }
+		static uint64 MakeKey(const CoverNodeRef& nodeRef) { return ((uint64)(uint32)(nodeRef.objectID + 1) << 32) | (uint32)nodeRef.node; } // 0 - empty slot
+		static uint64 MakeClaim(uint32 claimantID, uint32 expiryMs) { return ((uint64)claimantID << 32) | expiryMs; }                  // 0 - not claimed
+
+		TArray<int64> _keys;
+		TArray<int64> _claims; //claimant ID << 32 | expiry time in ms
+		int32  _numKeys = 0;
+		int32  _numFailedClaims = 0;
+		double _timeOrigin = 0.0;
+	};
+
+	typedef TSharedPtr<CoverClaimTable, ESPMode::ThreadSafe> CoverClaimTablePtr;
+	CoverClaimTablePtr _claims;
+
+	//queries of a single frame
+	struct CoverQueryBatch
+	{
+		TSharedPtr<CoverQueryIndex, ESPMode::ThreadSafe> index;
+		CoverClaimTablePtr claims;
+		TArray<CoverQuery> queries;
+		TArray<CoverQueryCallback> callbacks;
+		TArray<TArray<CoverNodeRef>> results;
+		TArray<int32> order; //queries sorted by the cell of their origin, so neighbouring queries run together
+		FGraphEventRef task;
+	};
+
+	TSharedPtr<CoverQueryIndex, ESPMode::ThreadSafe> _queryIndex;
+	bool _bQueryIndexDirty = true;        //cover changed since the index was built
+	CoverQueryBatch  _queuedQueries;      //issued since the last tick
+	CoverQueryBatch* _runningQueryBatch = nullptr;
+
+	//Cover occupancy
+	//oriented box in front of an edge of a cover segment (in place of a trigger box actor), pawns inside it are in the cover of the closest slot
+	struct CoverOccupancyBox
+	{
+		FVector vCenter  = FVector::ZeroVector;
+		FQuat   qRotation = FQuat::Identity;
+		FVector vExtent  = FVector(32.0f); //extent of a default box component
+		CoverNodeRef nodeRef;              //first slot of the segment
+		int32 slotCount = 1;               //slots of the segment
+		float fStartDistance = 0.0f;       //where the box starts along the segment
+		float fSlotStep = 0.0f;
+		bool bActive = false;              //false - the box's entry in _occupancyBoxes is free
+	};
+
+	struct PawnOccupancy
+	{
+		TWeakObjectPtr<APawn> pawn;
+		int32 box = INDEX_NONE;
+		CoverNodeRef nodeRef; //slot the pawn entered, it leaves the same one
+	};
+
+	TArray<CoverOccupancyBox>  _occupancyBoxes;
+	TArray<int32>              _freeOccupancyBoxes;
+	int32                      _numOccupancyBoxes = 0;
+	TMap<FIntPoint, TArray<int32>> _occupancyCells;  //boxes by every XY cell they can touch a pawn in (OccupancyCellSize)
+	TMap<uint32, PawnOccupancy> _pawnOccupancy;      //pawns that are in a box right now, by pawn's unique ID
+
+	//Debug drawing
+	//every category has its own console variable (cover.Debug.*)
+	enum ECoverDebugCategory : uint8
+	{
+		CDC_Nodes,        //nodes with their normal and height
+		CDC_Links,        //links between connected nodes
+		CDC_Optimization, //chain starts and removed nodes, recorded while optimizing
+		CDC_Geometry,     //edge links of CoverFromGeometry actors, recorded while preparing them
+		CDC_MissedRays,   //column rays, recorded while tracing
+		CDC_Occupancy,    //occupancy boxes
+		CDC_Count
+	};
+
+	struct CoverDebugLine
+	{
+		FVector vStart;
+		FVector vEnd;
+		FColor  color;
+		uint8   category;
+	};
+
+	struct CoverDebugPoint
+	{
+		FVector vPosition;
+		FColor  color;
+		float   fSize;
+		uint8   category;
+	};
+
+	//lines and points of one batch, arrows and boxes are split into lines
+	struct CoverDebugShapes
+	{
+		TArray<CoverDebugLine>  lines;
+		TArray<CoverDebugPoint> points;
+
+		void AddLine(uint8 category, const FVector& vStart, const FVector& vEnd, const FColor& color);
+		void AddArrow(uint8 category, const FVector& vStart, const FVector& vEnd, float fArrowSize, const FColor& color);
+		void AddPoint(uint8 category, const FVector& vPosition, float fSize, const FColor& color);
+		void AddBox(uint8 category, const FVector& vCenter, const FVector& vExtent, const FQuat& qRotation, const FColor& color);
 	};
 
+	ULineBatchComponent* _debugDraw = nullptr; //created the first time a category is switched on
+	TMap<int32, CoverDebugShapes> _debugShapes;       //shapes recorded while generating, by object ID
+	uint32  _debugDrawMask = 0;                       //categories in the current buffer
+	static uint32 _debugDrawEnabledMask;              //categories switched on, cached so ticks with drawing off don't read the variables
+	static FAutoConsoleVariableSink _debugDrawSink;
+	float   _fDebugDrawDistance = 0.0f;
+	FVector _vDebugDrawOrigin = FVector::ZeroVector;  //camera location the buffer was culled around
+	bool    _bDebugDrawDirty = true;                  //cover or recorded shapes changed since the buffer was built
+
+	//CoverCore's rays of a single column, traced through the physics scene or read from hits that were traced up front (batched and local traces)
+	class ColumnRayQuery : public CoverCore::IRayQuery
+	{
+	public:
+		ColumnRayQuery(CoverGen* coverGen, CoverWorkItem* work, const RayColumn& column, const std::vector<RayHit>* tracedHits);
+		virtual bool Raycast(int32 rayIndex, const CoverCore::Vector& vStart, const CoverCore::Vector& vDirection, float maxDistance, RayHit& outHit) override;
+
+	private:
+		CoverGen* _coverGen;
+		CoverWorkItem* _work;
+		const std::vector<RayHit>* _tracedHits; //nullptr - rays are traced one by one
+		CoverDebugShapes* _debugRays;           //nullptr - the column isn't drawn by cover.Debug.MissedRays
+	};
+
+	int32 _nextObjectID = 0;
+	CoverCore::Workspace _workspace; //objects prepared or traced column by column on the game thread
+
+	//worker threads take a workspace from the pool for each object, workspaces are kept until the generator is destroyed so their buffers stay warm
+	FCriticalSection _workspacePoolLock;
+	TArray<CoverCore::Workspace*> _freeWorkspaces;
+	TArray<CoverCore::Workspace*> _allWorkspaces;
+
+	//Levels
+	TMap<ULevel*, LevelCover*> _levels; //levels that have cover (generated, being generated or loaded)
+	FDelegateHandle _levelAddedHandle;
+	FDelegateHandle _levelRemovedHandle;
+
+	TArray<CoverWorkItem*> _pendingWork;      //objects that were prepared but don't have their cover yet
+	TArray<PendingColumn>  _inFlightColumns;  //columns submitted on the previous frame
+
+	//Scheduler
+	TArray<TWeakObjectPtr<AActor>> _actorsToPrepare;
+	int32  _nextActorToPrepare = 0;
+	int32  _actorsFinished = 0;
+	int32  _loggedProgress = -1; //whole percent of the last progress line
+	bool   _bGenerationReported = false;
+	float  _spacing = 10.0f;
+	double _generationStartTime = 0.0;
+	CoverGenStats _generationStats; //objects finished since generation started
+	FString _statsCsvRows;          //waiting to be appended to statsCsvPath
+
+	//Incremental updates
+	struct TrackedActor
+	{
+		TWeakObjectPtr<AActor> actor;
+		CoverObject* coverObject = nullptr; //nullptr if the actor doesn't give cover right now
+		FDelegateHandle transformUpdatedHandle;
+	};
+
+	struct DirtyActor
+	{
+		TWeakObjectPtr<AActor> actor;
+		double lastChangeTime = 0.0;
+		bool bDestroyed = false;
+	};
+
+	TMap<uint32, TrackedActor> _trackedActors; //by actor's unique ID
+	TMap<uint32, DirtyActor>   _dirtyActors;
+	UCoverActorListener* _actorListener = nullptr;
+	FDelegateHandle _actorSpawnedHandle;
+
 private:
-	void GenerateCoverPoints(int32 levelIndex = 0, float spacing = 10.0f);
+	void GenerateCoverPoints(ULevel* level, float spacing = 10.0f);
+	bool LoadBakedCover(LevelCover* levelCover);
+	bool LoadBakedCoverData(LevelCover* levelCover, const uint8* data, int64 dataSize);
+	void ReleaseBakedCover(LevelCover* levelCover); //objects using the baked nodes have to be deleted first
+	bool PrepareNextActor();
+
+	//Cover queries
+	void RebuildQueryIndex();
+	static void RunCoverQuery(const CoverQueryIndex& index, CoverClaimTable* claims, const CoverQuery& query, TArray<CoverNodeRef>& outNodes);
+	void CompactCoverClaims();
+	void StartQueryBatch();
+	void FinishQueryBatch();
+
+	//Level streaming
+	void OnLevelAdded(ULevel* level, UWorld* world);
+	void OnLevelRemoved(ULevel* level, UWorld* world);
+	void ReleaseLevelCover(ULevel* level);
+
+	//Incremental updates
+	void TrackActor(AActor* actor);
+	void UntrackActor(uint32 actorUniqueID);
+	void MarkActorDirty(AActor* actor, bool bDestroyed);
+	void OnActorSpawned(AActor* actor);
+	void OnActorDestroyed(AActor* actor);
+	void OnActorTransformUpdated(USceneComponent* updatedComponent, EUpdateTransformFlags updateTransformFlags, ETeleportType teleport);
+	void UpdateDirtyActors();
+	void ReplaceCoverNodes(CoverObject* target, CoverObject* source);
+	void RemoveCoverObject(CoverObject* coverObject);
+	void ReleaseOccupancyBoxes(CoverObject* coverObject);
+
+	void RunScheduledWork(double budgetSeconds); // budgetSeconds <= 0 - no time limit
+	CoverWorkItem* PrepareCoverWork(AActor* actor, float spacing, CoverObject* replacedObject = nullptr);
+	void QueueCoverWork(CoverWorkItem* work);
+	void RunCoverWork(TArray<CoverWorkItem*>& workItems, bool bTraceColumns);
+	void TraceColumns(CoverWorkItem* work, CoverCore::Workspace& workspace);
+	void TraceColumn(CoverWorkItem* work, const RayColumn& column, CoverCore::Workspace& workspace);
+	void FinalizeCoverWork(CoverWorkItem* work, CoverCore::Workspace& workspace);
+	CoverCore::Workspace* AcquireWorkspace();
+	void ReleaseWorkspace(CoverCore::Workspace* workspace);
+	void PublishCoverStats(const CoverWorkItem* work); //STAT counters, log and CSV row of a finished object
+	void WriteStatsCsv();
+	void BuildEdgeLinkColumns(AActor* actor, int32 objectID, const TArray<FVector>& scaledTris, const SweepParams& sweep, std::vector<RayColumn>& outColumns, SIZE_T& outEdgeLinkBytes);
+	CoverCore::GenerationSettings GetCoreSettings() const;
+	void ResolveColumn(CoverWorkItem* work, const RayColumn& column, const std::vector<CoverCore::Vector>& rayStarts, const std::vector<RayHit>* tracedHits = nullptr);
+	bool HasAxisAlignedBoxCollision(AActor* actor) const;
+
+	//Local geometry traces
+	void BuildGeometryBVH(const TArray<FVector>& scaledTris, GeometryBVH& outBVH);
+	void TraceColumnLocally(const CoverWorkItem* work, const RayColumn& column, const std::vector<CoverCore::Vector>& rayStarts, std::vector<RayHit>& outHits) const;
+	void TraceGeometryPacket(const GeometryBVH& bvh, const CoverCore::Vector* rayStarts, int32 rayCount, const FVector& direction, float maxDistance, RayHit* outHits) const;
+
+	//Batched traces
+	void SubmitTraceBatch();
+	void CollectTraceBatch();
+	void ResolveReadyColumns();
+
 	CoverActors* GetActorsWithCoverFlagInTheScene();
 	FVector RayHitTest(FVector StartTrace, FVector ForwardVector, float MaxDistance, AActor* ActorTested, FVector &outNormal,  FColor rayDebugColor = FColor::Red);
-	inline void DrawBoundingBoxEdges(AActor*& actorRef);
-	inline bool isVecHeightInBounds(const float& boundingBoxBottom, FVector& vec, float min, float max);
-	inline void MargeNodesInProximity(CoverObject*& coverObject, float radius, bool margeOnlyNodesWithTheSameNormal = true);
-	inline void MargeNodesInProximity2D(CoverObject*& coverObject, float radius);
-	inline void DebugDrawAllCoverNodes();
-	inline void DebugCheckForDuplicates(CoverObject*& coverObject);
-	inline void OrganizeCoverNodesByDistance(CoverObject*& _coverObject);
-	inline void OptimizeCoverNodes(CoverObject*& _coverObject, float _spacing);
-	inline void RemoveUpAndDownNodes(CoverObject*& _coverObject, float maxUp = 0.8f); // used to remove nodes that's normal faces too much up or down as these are not valid cover nodes
+	inline void DrawBoundingBoxEdges(AActor*& actorRef, int32 objectID);
 	inline float roundFloat(float& var) { float value = (int)(var * 100.0f + 0.5f); return (float)value / 100.0f; }
 	inline FVector roundVector(FVector& vec) { return FVector(roundFloat(vec.X), roundFloat(vec.Y), roundFloat(vec.Z)); }
-	inline void SortArrayByLowestHeight(TArray<FVector>& arr);
-	inline bool NormalCheck2D(FVector& Normal, float Range) { if (Normal.X < Range && Normal.X > -Range && Normal.Y < Range && Normal.Y > -Range) return true; return false; }
 
 	//Accessing geometry data
-	inline TArray<FVector> GetActorsVertexPositon(AActor* actor);
 	inline TArray<FVector> ReconstructAndScaleActorTriangles(AActor* actor);
 	inline FVector CalculateSurfaceNormalOfATriangle(FVector& p1, FVector& p2, FVector& p3);
 	inline FVector CalculateCenterOfATriangle(FVector& p1, FVector& p2, FVector& p3);
 	//inline FVector CalculateAndCenterNormalOfATriangle(FVector& p1, FVector& p2, FVector& p3);
 	inline bool isTriangleInZRange(float MinZ, float MaxZ, FVector& p1, FVector& p2, FVector& p3);
-	inline void CreateEdgeLinks(const TArray<FVector>& triangles, TArray<FVector>& vertices, TArray<Edge2*>& edgesOut);
-	inline void FindEdgeLink(int& currentIndex, TArray<FVector>& vertices, TArray<CoverGen::Edge2*>& edgesOut, FVector& V1, FVector& V2, FVector& V3, FVector triangleNormal, bool ignoreSurfacesWithVerticalFaces = false);
-
-	//Trigger box generation
-	inline void GetNodesInRadius(CoverObject*& _coverObject, FVector _searchPos, float _searchRadius, TArray<CoverNode*>& _outCoverNodesFound);
-	inline CoverNode* GetLowestNodeInPosition(CoverObject*& _coverObject, FVector2D _searchPos, float _posErrorAcceptance);
-	void CreateTriggerBoxData(CoverObject*& _coverObject);
-	inline void SetTriggerBoxTransform(ACoverTriggerBox* triggerBox, CoverNode* currentNode, CoverNode* nextNode, const FVector objectsScale);
+
+	//Occupancy box generation
+	inline void GetNodesInRadius(CoverObject*& _coverObject, FVector _searchPos, float _searchRadius, TArray<CoverNodeHandle>& _outCoverNodesFound);
+	inline CoverNodeHandle GetLowestNodeInPosition(CoverObject*& _coverObject, FVector2D _searchPos, float _posErrorAcceptance);
+	void CreateOccupancyBoxes(CoverObject*& _coverObject);
+	inline void SetOccupancyBoxTransform(CoverOccupancyBox& occupancyBox, const CoverNodeStore& nodes, CoverNodeHandle currentNode, CoverNodeHandle nextNode, const FVector objectsScale);
+	static CoverNodeRef GetOccupiedSlot(const CoverOccupancyBox& occupancyBox, const FVector& vLocalLocation); //slot closest to a pawn inside the box
+	int32 AddOccupancyBox(const CoverOccupancyBox& occupancyBox);
+	static void GetOccupancyBoxCells(const CoverOccupancyBox& occupancyBox, FIntPoint& outMinCell, FIntPoint& outMaxCell);
+	void UpdateOccupancy(); //tests every pawn against the boxes and raises enter/exit events
+
+	//Debug drawing
+	static uint32 GetDebugDrawMask() { return _debugDrawEnabledMask; } //bit per ECoverDebugCategory that is switched on
+	static void UpdateDebugDrawEnabledMask(); //reads the cover.Debug.* variables, only when console variables change
+	bool IsDebugDrawActive() const { return _debugDrawEnabledMask != 0 || _debugDrawMask != 0; }
+	CoverDebugShapes* GetDebugShapes(int32 objectID, ECoverDebugCategory category); //nullptr - category is off or we aren't on the game thread
+	CoverDebugShapes* GetMissedRayDebugShapes(int32 objectID, int32 debugSide);
+	void UpdateDebugDraw(); //rebuilds the line buffer once cover changed or the camera moved
+	void AddNodeDebugShapes(CoverObject* coverObject, uint32 mask, const FVector& vViewOrigin, float drawDistance, const FColor& nodeColor, CoverDebugShapes& outShapes) const;
 	//inline void CreateCoverNodesFromPositionVectors(TArray)
 };
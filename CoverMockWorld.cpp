@@ -0,0 +1,309 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoverMockWorld.h"
+
+#include <algorithm>
+
+namespace CoverCore
+{
+	//triangles per BVH leaf, objects with fewer triangles are a single leaf
+	static const int32_t MockLeafSize = 16;
+
+	namespace
+	{
+		//slab test, true if the ray enters the box before maxDistance
+		bool RayHitsBox(const Vector& vStart, const Vector& vDirection, const Vector& vMin, const Vector& vMax, float maxDistance)
+		{
+			float nearDistance = 0.0f;
+			float farDistance = maxDistance;
+
+			for (int32_t axis = 0; axis < 3; ++axis)
+			{
+				if (std::fabs(vDirection[axis]) < 1.e-8f)
+				{
+					if (vStart[axis] < vMin[axis] || vStart[axis] > vMax[axis])
+						return false;
+
+					continue;
+				}
+
+				const float inverseDirection = 1.0f / vDirection[axis];
+				const float slabDistance1 = (vMin[axis] - vStart[axis]) * inverseDirection;
+				const float slabDistance2 = (vMax[axis] - vStart[axis]) * inverseDirection;
+				nearDistance = std::max(nearDistance, std::min(slabDistance1, slabDistance2));
+				farDistance = std::min(farDistance, std::max(slabDistance1, slabDistance2));
+
+				if (farDistance < nearDistance)
+					return false;
+			}
+
+			return true;
+		}
+	}
+
+	int32_t MockWorld::AddBox(const Vector& vCenter, const Vector& vHalfSize, float yawDegrees)
+	{
+		const float yaw = yawDegrees * 3.14159265f / 180.0f;
+		const float cosYaw = std::cos(yaw);
+		const float sinYaw = std::sin(yaw);
+
+		//bit per axis, set - positive side of the box
+		Vector corners[8];
+		for (int32_t corner = 0; corner < 8; ++corner)
+		{
+			const Vector vLocal((corner & 1) ? vHalfSize.X : -vHalfSize.X, (corner & 2) ? vHalfSize.Y : -vHalfSize.Y, (corner & 4) ? vHalfSize.Z : -vHalfSize.Z);
+			corners[corner] = vCenter + Vector(vLocal.X * cosYaw - vLocal.Y * sinYaw, vLocal.X * sinYaw + vLocal.Y * cosYaw, vLocal.Z);
+		}
+
+		//every face is two triangles, wound so their normal points out of the box
+		static const int32_t faces[6][4] = { { 0, 2, 6, 4 }, { 1, 5, 7, 3 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, { 0, 1, 3, 2 }, { 4, 6, 7, 5 } };
+
+		MockObject object;
+		object.triangles.reserve(36);
+
+		for (const int32_t* face : faces)
+		{
+			const Vector vFaceCenter = (corners[face[0]] + corners[face[1]] + corners[face[2]] + corners[face[3]]) / 4.0f;
+			const bool bFlip = Vector::Dot(Vector::Cross(corners[face[1]] - corners[face[0]], corners[face[2]] - corners[face[0]]), vFaceCenter - vCenter) < 0.0f;
+
+			const int32_t triangles[2][3] = { { face[0], face[1], face[2] }, { face[0], face[2], face[3] } };
+			for (const int32_t* triangle : triangles)
+			{
+				object.triangles.push_back(corners[triangle[0]]);
+				object.triangles.push_back(corners[triangle[bFlip ? 2 : 1]]);
+				object.triangles.push_back(corners[triangle[bFlip ? 1 : 2]]);
+			}
+		}
+
+		const float yawRemainder = std::fabs(std::fmod(yawDegrees, 90.0f));
+		object.bAxisAlignedBox = yawRemainder <= 0.1f || yawRemainder >= 89.9f;
+		return AddObject(std::move(object));
+	}
+
+	int32_t MockWorld::AddMesh(const std::vector<Vector>& triangles)
+	{
+		MockObject object;
+		object.triangles = triangles;
+		return AddObject(std::move(object));
+	}
+
+	int32_t MockWorld::AddObject(MockObject&& object)
+	{
+		const int32_t objectIndex = (int32_t)_objects.size();
+
+		object.vMin = object.vMax = object.triangles.empty() ? Vector() : object.triangles[0];
+		for (const Vector& vertex : object.triangles)
+			for (int32_t axis = 0; axis < 3; ++axis)
+			{
+				object.vMin[axis] = std::min(object.vMin[axis], vertex[axis]);
+				object.vMax[axis] = std::max(object.vMax[axis], vertex[axis]);
+			}
+
+		const int32_t minX = (int32_t)std::floor(object.vMin.X / _fCellSize), maxX = (int32_t)std::floor(object.vMax.X / _fCellSize);
+		const int32_t minY = (int32_t)std::floor(object.vMin.Y / _fCellSize), maxY = (int32_t)std::floor(object.vMax.Y / _fCellSize);
+
+		for (int32_t x = minX; x <= maxX; ++x)
+			for (int32_t y = minY; y <= maxY; ++y)
+				_cells[GetCellKey(x, y)].push_back(objectIndex);
+
+		BuildBVH(object);
+		_objects.push_back(std::move(object));
+		return objectIndex;
+	}
+
+	void MockWorld::BuildBVH(MockObject& object) const
+	{
+		const int32_t triangleCount = (int32_t)(object.triangles.size() / 3);
+		object.bvh.clear();
+		object.bvhTriangles.clear();
+
+		if (triangleCount == 0)
+			return;
+
+		std::vector<Vector> centers(triangleCount);
+
+		object.bvhTriangles.resize(triangleCount);
+		for (int32_t triangle = 0; triangle < triangleCount; ++triangle)
+		{
+			object.bvhTriangles[triangle] = triangle;
+			centers[triangle] = (object.triangles[triangle * 3] + object.triangles[triangle * 3 + 1] + object.triangles[triangle * 3 + 2]) / 3.0f;
+		}
+
+		object.bvh.reserve(std::max(1, triangleCount / MockLeafSize * 2 + 1));
+		object.bvh.push_back(MockBVHNode());
+		object.bvh[0].count = triangleCount;
+
+		//nodes are split at the median of their longest axis until they are small enough to be leaves
+		std::vector<int32_t> nodesToSplit(1, 0);
+
+		while (!nodesToSplit.empty())
+		{
+			const int32_t nodeIndex = nodesToSplit.back();
+			nodesToSplit.pop_back();
+
+			MockBVHNode node = object.bvh[nodeIndex];
+			node.vMin = node.vMax = object.triangles[object.bvhTriangles[node.first] * 3];
+
+			for (int32_t index = node.first; index < node.first + node.count; ++index)
+				for (int32_t vertex = 0; vertex < 3; ++vertex)
+					for (int32_t axis = 0; axis < 3; ++axis)
+					{
+						const float value = object.triangles[object.bvhTriangles[index] * 3 + vertex][axis];
+						node.vMin[axis] = std::min(node.vMin[axis], value);
+						node.vMax[axis] = std::max(node.vMax[axis], value);
+					}
+
+			if (node.count > MockLeafSize)
+			{
+				const Vector vSize = node.vMax - node.vMin;
+				const int32_t splitAxis = vSize.X >= vSize.Y && vSize.X >= vSize.Z ? 0 : (vSize.Y >= vSize.Z ? 1 : 2);
+				const int32_t half = node.count / 2;
+
+				std::nth_element(object.bvhTriangles.begin() + node.first, object.bvhTriangles.begin() + node.first + half, object.bvhTriangles.begin() + node.first + node.count,
+					[&centers, splitAxis](int32_t A, int32_t B) { return centers[A][splitAxis] < centers[B][splitAxis]; });
+
+				const int32_t firstChild = (int32_t)object.bvh.size();
+				object.bvh.resize(firstChild + 2);
+				object.bvh[firstChild].first = node.first;
+				object.bvh[firstChild].count = half;
+				object.bvh[firstChild + 1].first = node.first + half;
+				object.bvh[firstChild + 1].count = node.count - half;
+
+				node.first = firstChild;
+				node.count = 0;
+				nodesToSplit.push_back(firstChild);
+				nodesToSplit.push_back(firstChild + 1);
+			}
+
+			object.bvh[nodeIndex] = node;
+		}
+	}
+
+	ObjectInput MockWorld::MakeObjectInput(int32_t objectIndex, bool bFromGeometry) const
+	{
+		const MockObject& object = _objects[objectIndex];
+
+		ObjectInput input;
+		input.vBoundsCenter = (object.vMin + object.vMax) / 2.0f;
+		input.vBoundsHalfSize = (object.vMax - object.vMin) / 2.0f;
+		input.bFromGeometry = bFromGeometry;
+		input.bAnalytic = !bFromGeometry && object.bAxisAlignedBox;
+
+		if (bFromGeometry)
+			input.triangles = object.triangles;
+
+		return input;
+	}
+
+	bool MockWorld::Raycast(const Vector& vStart, const Vector& vDirection, float maxDistance, RayHit& outHit, int32_t& outObject) const
+	{
+		outHit = RayHit();
+		outObject = -1;
+		float bestDistance = maxDistance;
+
+		const Vector vEnd = vStart + vDirection * maxDistance;
+		const int32_t minX = (int32_t)std::floor(std::min(vStart.X, vEnd.X) / _fCellSize), maxX = (int32_t)std::floor(std::max(vStart.X, vEnd.X) / _fCellSize);
+		const int32_t minY = (int32_t)std::floor(std::min(vStart.Y, vEnd.Y) / _fCellSize), maxY = (int32_t)std::floor(std::max(vStart.Y, vEnd.Y) / _fCellSize);
+
+		//objects that span several cells are listed in each of them
+		std::vector<int32_t>& candidates = _candidates;
+		candidates.clear();
+
+		for (int32_t x = minX; x <= maxX; ++x)
+			for (int32_t y = minY; y <= maxY; ++y)
+			{
+				const auto cell = _cells.find(GetCellKey(x, y));
+				if (cell != _cells.end())
+					candidates.insert(candidates.end(), cell->second.begin(), cell->second.end());
+			}
+
+		std::sort(candidates.begin(), candidates.end());
+		candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+		for (int32_t objectIndex : candidates)
+			RaycastObject(objectIndex, vStart, vDirection, bestDistance, outHit, outObject);
+
+		return outHit.bHit;
+	}
+
+	void MockWorld::RaycastObject(int32_t objectIndex, const Vector& vStart, const Vector& vDirection, float& bestDistance, RayHit& outHit, int32_t& outObject) const
+	{
+		const MockObject& object = _objects[objectIndex];
+
+		if (object.bvhTriangles.empty())
+			return;
+
+		int32_t nodeStack[64];
+		int32_t stackSize = 0;
+		nodeStack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			const MockBVHNode& node = object.bvh[nodeStack[--stackSize]];
+
+			if (!RayHitsBox(vStart, vDirection, node.vMin, node.vMax, bestDistance))
+				continue;
+
+			if (node.count == 0)
+			{
+				nodeStack[stackSize++] = node.first;
+				nodeStack[stackSize++] = node.first + 1;
+				continue;
+			}
+
+			//Moller-Trumbore
+			for (int32_t index = node.first; index < node.first + node.count; ++index)
+			{
+				const size_t vertex = (size_t)object.bvhTriangles[index] * 3;
+				const Vector& V0 = object.triangles[vertex];
+				const Vector vEdge1 = object.triangles[vertex + 1] - V0;
+				const Vector vEdge2 = object.triangles[vertex + 2] - V0;
+				const Vector P = Vector::Cross(vDirection, vEdge2);
+				const float determinant = Vector::Dot(vEdge1, P);
+
+				if (std::fabs(determinant) < 1.e-8f)
+					continue;
+
+				const float inverseDeterminant = 1.0f / determinant;
+				const Vector S = vStart - V0;
+				const float U = Vector::Dot(S, P) * inverseDeterminant;
+				if (U < 0.0f || U > 1.0f)
+					continue;
+
+				const Vector Q = Vector::Cross(S, vEdge1);
+				const float V = Vector::Dot(vDirection, Q) * inverseDeterminant;
+				if (V < 0.0f || U + V > 1.0f)
+					continue;
+
+				const float T = Vector::Dot(vEdge2, Q) * inverseDeterminant;
+				if (T <= 1.e-4f || T >= bestDistance)
+					continue;
+
+				//same as a physics trace, the normal faces the ray
+				const Vector vNormal = Vector::Cross(vEdge1, vEdge2).GetSafeNormal();
+				bestDistance = T;
+				outObject = objectIndex;
+				outHit.bHit = true;
+				outHit.fDistance = T;
+				outHit.vImpact = vStart + vDirection * T;
+				outHit.vNormal = Vector::Dot(vNormal, vDirection) > 0.0f ? -vNormal : vNormal;
+			}
+		}
+	}
+
+	bool MockRayQuery::Raycast(int32_t /*rayIndex*/, const Vector& vStart, const Vector& vDirection, float maxDistance, RayHit& outHit)
+	{
+		int32_t hitObject = -1;
+		const bool bHit = _world.Raycast(vStart, vDirection, maxDistance, outHit, hitObject) && hitObject == _objectIndex;
+
+		if (_stats)
+		{
+			_stats->raysCast++;
+			if (bHit) _stats->rayHits++;
+			else      _stats->rayMisses++;
+		}
+
+		return bHit;
+	}
+}
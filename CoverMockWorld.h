@@ -0,0 +1,75 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoverCore.h"
+
+#include <unordered_map>
+
+//In-memory world for running CoverCore without the engine (profiling on build agents, benchmarks)
+namespace CoverCore
+{
+	//boxes and triangle meshes, rays are traced against every object in the XY cells they cross
+	class MockWorld
+	{
+	public:
+		explicit MockWorld(float cellSize = 1000.0f) : _fCellSize(cellSize) {}
+
+		//returns the index of the new object
+		int32_t AddBox(const Vector& vCenter, const Vector& vHalfSize, float yawDegrees = 0.0f);
+		int32_t AddMesh(const std::vector<Vector>& triangles); //world space soup, outer faces wind so that (V1 - V0) x (V2 - V0) points out of the mesh
+
+		inline int32_t Num() const { return (int32_t)_objects.size(); }
+		inline const std::vector<Vector>& GetTriangles(int32_t objectIndex) const { return _objects[objectIndex].triangles; }
+
+		//bounds, triangles and flags of an object the way the engine adapter fills them in
+		ObjectInput MakeObjectInput(int32_t objectIndex, bool bFromGeometry) const;
+
+		//closest hit on any object, outObject - index of the object that was hit
+		bool Raycast(const Vector& vStart, const Vector& vDirection, float maxDistance, RayHit& outHit, int32_t& outObject) const;
+
+	private:
+		//inner nodes have count 0 and their children at first and first + 1
+		struct MockBVHNode
+		{
+			Vector  vMin;
+			Vector  vMax;
+			int32_t first = 0;
+			int32_t count = 0;
+		};
+
+		struct MockObject
+		{
+			std::vector<Vector> triangles;
+			std::vector<MockBVHNode> bvh;       //leaves point into bvhTriangles
+			std::vector<int32_t> bvhTriangles;  //triangle indices (first vertex / 3) in leaf order
+			Vector vMin;
+			Vector vMax;
+			bool   bAxisAlignedBox = false;
+		};
+
+		int32_t AddObject(MockObject&& object);
+		void BuildBVH(MockObject& object) const;
+		void RaycastObject(int32_t objectIndex, const Vector& vStart, const Vector& vDirection, float& bestDistance, RayHit& outHit, int32_t& outObject) const;
+		inline int64_t GetCellKey(int32_t x, int32_t y) const { return ((int64_t)x << 32) | (uint32_t)y; }
+
+		float _fCellSize;
+		std::vector<MockObject> _objects;
+		std::unordered_map<int64_t, std::vector<int32_t>> _cells; //objects by every XY cell their bounds touch
+		mutable std::vector<int32_t> _candidates;                 //reused by Raycast so rays don't allocate, a world is traced from one thread at a time
+	};
+
+	//rays of a single object, anything else that is hit first blocks them
+	class MockRayQuery : public IRayQuery
+	{
+	public:
+		MockRayQuery(const MockWorld& world, int32_t objectIndex, GenerationStats* stats = nullptr) : _world(world), _objectIndex(objectIndex), _stats(stats) {}
+
+		virtual bool Raycast(int32_t rayIndex, const Vector& vStart, const Vector& vDirection, float maxDistance, RayHit& outHit) override;
+
+	private:
+		const MockWorld& _world;
+		int32_t _objectIndex;
+		GenerationStats* _stats; //rays cast, hits and misses
+	};
+}
@@ -47,6 +47,35 @@ ACoverSystemCharacter::ACoverSystemCharacter()
 	// are set in the derived blueprint asset named MyCharacter (to avoid direct content references in C++)
 }
 
+void ACoverSystemCharacter::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (!coverGen)
+	{
+		CoverGenSettings coverGenSettings;
+		coverGenSettings.bBatchedTraces = true; //spread the rays over the next frames instead of tracing everything now
+		coverGenSettings.bParallelGeneration = true;
+		coverGenSettings.frameBudgetMs = 2.0f; //cover fills in over the first frames instead of stalling one
+		coverGenSettings.bLoadBakedCover = true;
+		coverGenSettings.bBakeCover = GIsEditor; //bake when playing in the editor so standalone runs only have to map the file
+		coverGenSettings.bIncrementalUpdates = true;
+		coverGenSettings.bAnalyticBoxCover = true;
+		coverGenSettings.bFollowLevelStreaming = true;
+
+		coverGen = new CoverGen(GetWorld(), coverGenSettings); //init here for testing purposes
+	}
+}
+
+void ACoverSystemCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	//CoverGen is subscribed to world and actor events, it has to go before the world does
+	delete coverGen;
+	coverGen = nullptr;
+
+	Super::EndPlay(EndPlayReason);
+}
+
 //////////////////////////////////////////////////////////////////////////
 // Input
 
@@ -121,9 +150,6 @@ void ACoverSystemCharacter::MoveForward(float Value)
 		// get forward vector
 		const FVector Direction = FRotationMatrix(YawRotation).GetUnitAxis(EAxis::X);
 		AddMovementInput(Direction, Value);
-
-		if (!coverGen)
-			coverGen = new CoverGen(GetWorld()); //init here for testing purposes
 	}
 }
 